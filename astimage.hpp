@@ -0,0 +1,497 @@
+#ifndef astimage_hpp
+#define astimage_hpp
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "token.hpp"
+#include "syntaxtree.hpp"
+using namespace std;
+
+/*
+    Compact binary image of a syntax tree, so large scripts can skip lexing & parsing on startup.
+
+    <image>   := <header> <nodes> <strings>
+    <header>  := magic(u32) version(u32) stringsOffset(u32) stringCount(u32)
+    <nodes>   := pre-order node records, children follow their parent
+    <node>    := kind(u8) tokenType(u8) lexeme(u32) <payload>
+    <strings> := { length(u32) bytes }*
+
+    Every reference is an index or an offset, never a pointer, so the image
+    can be mapped anywhere. Number literals are stored already decoded, as the 8 bytes
+    of a double or a 64 bit integer; which one is told by the token type, or for the step
+    of an increment by a type(u8) ahead of it.
+*/
+
+const uint32_t astImageMagic = 0x49415056; // "VPAI"
+const uint32_t astImageVersion = 7;
+
+enum ImageNodeKind {
+    IK_NULL, IK_PROGRAM, IK_STMTLIST, IK_PARAMLIST, IK_PRINT, IK_WHILE, IK_IF, IK_VARDEF,
+    IK_FUNCDEF, IK_RETURN, IK_EXPRSTMT, IK_ID, IK_LITERAL, IK_LIST, IK_SUBSCRIPT,
+    IK_UNARY, IK_BINARY, IK_RELOP, IK_ASSIGN, IK_FUNCCALL, IK_MAP, IK_FOR, IK_INCREMENT, IK_YIELD, IK_SLICE
+};
+
+class ImageWriter : public Visitor<> {
+    private:
+        vector<char> nodes;
+        vector<string> strings;
+        unordered_map<string, uint32_t> stringIndex;
+        template <typename T> void emit(vector<char>& out, T value) {
+            const char* raw = reinterpret_cast<const char*>(&value);
+            out.insert(out.end(), raw, raw + sizeof(T));
+        }
+        //a double & an integer share the same 8 bytes of an Object
+        static uint64_t bitsOf(const Object& ob) {
+            uint64_t bits = 0;
+            if (isNumber(ob)) memcpy(&bits, &ob.intval, sizeof(bits));
+            return bits;
+        }
+        uint32_t intern(const string& str) {
+            auto it = stringIndex.find(str);
+            if (it != stringIndex.end())
+                return it->second;
+            uint32_t idx = strings.size();
+            strings.push_back(str);
+            stringIndex.emplace(str, idx);
+            return idx;
+        }
+        void header(ImageNodeKind kind, ASTNode* node) {
+            Token tk = node->getToken();
+            emit<uint8_t>(nodes, kind);
+            emit<uint8_t>(nodes, tk.type);
+            emit<uint32_t>(nodes, intern(tk.lexeme));
+        }
+        void child(ASTNode* node) {
+            if (node == nullptr) emit<uint8_t>(nodes, IK_NULL);
+            else node->accept(this);
+        }
+    public:
+        vector<char> write(ProgramStatement* ps) {
+            nodes.clear();
+            strings.clear();
+            stringIndex.clear();
+            ps->accept(this);
+            vector<char> image;
+            emit<uint32_t>(image, astImageMagic);
+            emit<uint32_t>(image, astImageVersion);
+            emit<uint32_t>(image, 4*sizeof(uint32_t) + nodes.size());
+            emit<uint32_t>(image, strings.size());
+            image.insert(image.end(), nodes.begin(), nodes.end());
+            for (auto& str : strings) {
+                emit<uint32_t>(image, str.size());
+                image.insert(image.end(), str.begin(), str.end());
+            }
+            return image;
+        }
+        bool writeFile(ProgramStatement* ps, string filename) {
+            vector<char> image = write(ps);
+            ofstream out(filename, ios::binary);
+            if (!out) {
+                cout<<"Couldn't open "<<filename<<" for writing."<<endl;
+                return false;
+            }
+            out.write(image.data(), image.size());
+            return out.good();
+        }
+        void visit(ProgramStatement* ps) override {
+            header(IK_PROGRAM, ps);
+            child(ps->getStatement());
+        }
+        void visit(StatementList* sl) override {
+            header(IK_STMTLIST, sl);
+            emit<uint32_t>(nodes, sl->getStatements().size());
+            for (auto m : sl->getStatements()) {
+                child(m);
+            }
+        }
+        void visit(ParameterList* pl) override {
+            header(IK_PARAMLIST, pl);
+            emit<uint32_t>(nodes, pl->getParams().size());
+            for (auto m : pl->getParams()) {
+                child(m);
+            }
+        }
+        void visit(PrintStatement* ps) override {
+            header(IK_PRINT, ps);
+            child(ps->getExpression());
+        }
+        void visit(WhileStatement* ws) override {
+            header(IK_WHILE, ws);
+            child(ws->getTestExpr());
+            child(ws->getLoopBody());
+        }
+        void visit(ForStatement* fs) override {
+            header(IK_FOR, fs);
+            emit<uint32_t>(nodes, intern(fs->getVarName()));
+            child(fs->getIterable());
+            child(fs->getLoopBody());
+        }
+        void visit(IfStatement* is) override {
+            header(IK_IF, is);
+            child(is->getTest());
+            child(is->getPassCase());
+            child(is->getFailCase());
+        }
+        void visit(VarDefStatement* vd) override {
+            header(IK_VARDEF, vd);
+            emit<uint32_t>(nodes, intern(vd->getName()));
+            child(vd->getExpr());
+        }
+        void visit(FuncDefStatement* ds) override {
+            header(IK_FUNCDEF, ds);
+            emit<uint32_t>(nodes, intern(ds->getName()));
+            emit<uint8_t>(nodes, ds->isMemoized() | ds->isGenerator() << 1);
+            child(ds->getParams());
+            child(ds->getBody());
+        }
+        void visit(ReturnStatement* rs) override {
+            header(IK_RETURN, rs);
+            child(rs->getRetVal());
+        }
+        void visit(YieldStatement* ys) override {
+            header(IK_YIELD, ys);
+            child(ys->getValue());
+        }
+        void visit(ExprStatement* es) override {
+            header(IK_EXPRSTMT, es);
+            child(es->getExpression());
+        }
+        void visit(IdExpression* idexpr) override {
+            header(IK_ID, idexpr);
+        }
+        void visit(LiteralExpression* lit) override {
+            header(IK_LITERAL, lit);
+            Environment none;
+            emit<uint64_t>(nodes, bitsOf(lit->eval(none)));
+        }
+        void visit(ListExpression* le) override {
+            header(IK_LIST, le);
+            emit<uint32_t>(nodes, le->getExprsList().size());
+            for (auto m : le->getExprsList()) {
+                child(m);
+            }
+        }
+        void visit(MapExpression* me) override {
+            header(IK_MAP, me);
+            emit<uint32_t>(nodes, me->getEntries().size());
+            for (auto& entry : me->getEntries()) {
+                child(entry.first);
+                child(entry.second);
+            }
+        }
+        void visit(SubscriptExpression* se) override {
+            header(IK_SUBSCRIPT, se);
+            child(se->getName());
+            child(se->getPosition());
+        }
+        void visit(SliceExpression* se) override {
+            header(IK_SLICE, se);
+            child(se->getName());
+            child(se->getFrom());
+            child(se->getTo());
+            child(se->getStride());
+        }
+        void visit(UnaryExpression* unary) override {
+            header(IK_UNARY, unary);
+            child(unary->getLeft());
+        }
+        void visit(BinaryExpression* bin) override {
+            header(IK_BINARY, bin);
+            child(bin->getLeft());
+            child(bin->getRight());
+        }
+        void visit(RelOpExpression* rel) override {
+            header(IK_RELOP, rel);
+            child(rel->getLeft());
+            child(rel->getRight());
+        }
+        void visit(AssignExpression* assign) override {
+            header(IK_ASSIGN, assign);
+            child(assign->getLeft());
+            child(assign->getRight());
+        }
+        void visit(IncrementExpression* inc) override {
+            header(IK_INCREMENT, inc);
+            child(inc->getTarget());
+            emit<uint8_t>(nodes, inc->getDelta().type);
+            emit<uint64_t>(nodes, bitsOf(inc->getDelta()));
+        }
+        void visit(FunctionCall* fc) override {
+            header(IK_FUNCCALL, fc);
+            child(fc->getName());
+            emit<uint32_t>(nodes, fc->getArgs().size());
+            for (auto m : fc->getArgs()) {
+                child(m);
+            }
+        }
+};
+
+class ImageLoader {
+    private:
+        const char* base;
+        size_t length;
+        size_t pos;
+        vector<string> strings;
+        template <typename T> T read() {
+            T value = T();
+            if (pos + sizeof(T) > length) {
+                pos = length;
+                return value;
+            }
+            memcpy(&value, base + pos, sizeof(T));
+            pos += sizeof(T);
+            return value;
+        }
+        Object number(ObjectType type) {
+            Object ob(0.0);
+            uint64_t bits = read<uint64_t>();
+            memcpy(&ob.intval, &bits, sizeof(bits));
+            ob.type = type == INTEGER ? INTEGER : NUMBER;
+            return ob;
+        }
+        bool loadStrings(uint32_t offset, uint32_t count) {
+            strings.clear();
+            strings.reserve(count);
+            pos = offset;
+            for (uint32_t i = 0; i < count; i++) {
+                if (pos + sizeof(uint32_t) > length) return false;
+                uint32_t len = read<uint32_t>();
+                if (pos + len > length) return false;
+                strings.emplace_back(base + pos, len);
+                pos += len;
+            }
+            return true;
+        }
+        string str(uint32_t idx) {
+            return idx < strings.size() ? strings[idx] : string();
+        }
+        template <typename T> T* as(ASTNode* node) {
+            return dynamic_cast<T*>(node);
+        }
+        StatementList* statementList() {
+            return as<StatementList>(node());
+        }
+        ASTNode* node() {
+            ImageNodeKind kind = (ImageNodeKind)read<uint8_t>();
+            if (kind == IK_NULL)
+                return nullptr;
+            TokenType type = (TokenType)read<uint8_t>();
+            Token tk(type, str(read<uint32_t>()));
+            switch (kind) {
+                case IK_PROGRAM: {
+                    ProgramStatement* ps = new ProgramStatement(tk);
+                    ps->setProgram(statementList());
+                    return ps;
+                }
+                case IK_STMTLIST: {
+                    uint32_t count = read<uint32_t>();
+                    list<StatementNode*> stmts;
+                    for (uint32_t i = 0; i < count; i++)
+                        stmts.push_back(as<StatementNode>(node()));
+                    return new StatementList(tk, stmts);
+                }
+                case IK_PARAMLIST: {
+                    uint32_t count = read<uint32_t>();
+                    ParameterList* pl = new ParameterList(tk);
+                    for (uint32_t i = 0; i < count; i++)
+                        pl->add(as<StatementNode>(node()));
+                    return pl;
+                }
+                case IK_PRINT: {
+                    PrintStatement* ps = new PrintStatement(tk);
+                    ps->setExpression(as<ExpressionNode>(node()));
+                    return ps;
+                }
+                case IK_WHILE: {
+                    WhileStatement* ws = new WhileStatement(tk);
+                    ws->setTestExpr(as<ExpressionNode>(node()));
+                    ws->setLoopBody(statementList());
+                    return ws;
+                }
+                case IK_FOR: {
+                    ForStatement* fs = new ForStatement(tk);
+                    fs->setVarName(str(read<uint32_t>()));
+                    fs->setIterable(as<ExpressionNode>(node()));
+                    fs->setLoopBody(statementList());
+                    return fs;
+                }
+                case IK_IF: {
+                    IfStatement* is = new IfStatement(tk);
+                    is->setTestExpr(as<ExpressionNode>(node()));
+                    is->setPassCase(statementList());
+                    is->setFailCase(statementList());
+                    return is;
+                }
+                case IK_VARDEF: {
+                    VarDefStatement* vd = new VarDefStatement(tk);
+                    vd->setName(str(read<uint32_t>()));
+                    vd->setExpr(as<ExpressionNode>(node()));
+                    return vd;
+                }
+                case IK_FUNCDEF: {
+                    FuncDefStatement* ds = new FuncDefStatement(tk);
+                    ds->setName(str(read<uint32_t>()));
+                    uint8_t flags = read<uint8_t>();
+                    ds->setMemoized(flags & 1);
+                    ds->setGenerator(flags & 2);
+                    ds->setParams(as<ParameterList>(node()));
+                    ds->setBody(statementList());
+                    return ds;
+                }
+                case IK_RETURN: {
+                    ReturnStatement* rs = new ReturnStatement(tk);
+                    rs->setRetVal(as<ExpressionNode>(node()));
+                    return rs;
+                }
+                case IK_YIELD: {
+                    YieldStatement* ys = new YieldStatement(tk);
+                    ys->setValue(as<ExpressionNode>(node()));
+                    return ys;
+                }
+                case IK_EXPRSTMT: {
+                    ExprStatement* es = new ExprStatement(tk);
+                    es->setExpr(as<ExpressionNode>(node()));
+                    return es;
+                }
+                case IK_ID: return new IdExpression(tk);
+                case IK_LITERAL: {
+                    Object num = number(type == TK_INTEGER ? INTEGER : NUMBER);
+                    switch (type) {
+                        case TK_NUMBER:
+                        case TK_INTEGER: return new LiteralExpression(tk, num);
+                        case TK_STRING: return new LiteralExpression(tk, Object(tk.lexeme));
+                        case TK_TRUE:   return new LiteralExpression(tk, Object(true));
+                        case TK_FALSE:  return new LiteralExpression(tk, Object(false));
+                        default: break;
+                    }
+                    return new LiteralExpression(tk, Object());
+                }
+                case IK_LIST: {
+                    uint32_t count = read<uint32_t>();
+                    ListExpression* le = new ListExpression(tk);
+                    for (uint32_t i = 0; i < count; i++)
+                        le->addExpr(as<ExpressionNode>(node()));
+                    return le;
+                }
+                case IK_MAP: {
+                    uint32_t count = read<uint32_t>();
+                    MapExpression* me = new MapExpression(tk);
+                    for (uint32_t i = 0; i < count; i++) {
+                        ExpressionNode* key = as<ExpressionNode>(node());
+                        me->addEntry(key, as<ExpressionNode>(node()));
+                    }
+                    return me;
+                }
+                case IK_SUBSCRIPT: {
+                    SubscriptExpression* se = new SubscriptExpression(tk);
+                    se->setName(as<ExpressionNode>(node()));
+                    se->setPosition(as<ExpressionNode>(node()));
+                    return se;
+                }
+                case IK_SLICE: {
+                    SliceExpression* se = new SliceExpression(tk);
+                    se->setName(as<ExpressionNode>(node()));
+                    se->setFrom(as<ExpressionNode>(node()));
+                    se->setTo(as<ExpressionNode>(node()));
+                    se->setStride(as<ExpressionNode>(node()));
+                    return se;
+                }
+                case IK_UNARY: {
+                    UnaryExpression* ue = new UnaryExpression(tk);
+                    ue->setLeft(as<ExpressionNode>(node()));
+                    return ue;
+                }
+                case IK_BINARY: {
+                    BinaryExpression* be = new BinaryExpression(tk);
+                    be->setLeft(as<ExpressionNode>(node()));
+                    be->setRight(as<ExpressionNode>(node()));
+                    return be;
+                }
+                case IK_RELOP: {
+                    RelOpExpression* re = new RelOpExpression(tk);
+                    re->setLeft(as<ExpressionNode>(node()));
+                    re->setRight(as<ExpressionNode>(node()));
+                    return re;
+                }
+                case IK_ASSIGN: {
+                    AssignExpression* ae = new AssignExpression(tk);
+                    ae->setLeft(as<ExpressionNode>(node()));
+                    ae->setRight(as<ExpressionNode>(node()));
+                    return ae;
+                }
+                case IK_INCREMENT: {
+                    IncrementExpression* ie = new IncrementExpression(tk);
+                    ie->setTarget(as<IdExpression>(node()));
+                    ie->setDelta(number((ObjectType)read<uint8_t>()));
+                    return ie;
+                }
+                case IK_FUNCCALL: {
+                    FunctionCall* fc = new FunctionCall(tk);
+                    fc->setName(as<IdExpression>(node()));
+                    uint32_t count = read<uint32_t>();
+                    list<ExpressionNode*> args;
+                    for (uint32_t i = 0; i < count; i++)
+                        args.push_back(as<ExpressionNode>(node()));
+                    fc->setArgs(args);
+                    return fc;
+                }
+                default: break;
+            }
+            cout<<"Corrupt AST image near offset "<<pos<<endl;
+            return nullptr;
+        }
+    public:
+        ImageLoader() : base(nullptr), length(0), pos(0) { }
+        ProgramStatement* load(const char* image, size_t len) {
+            base = image;
+            length = len;
+            pos = 0;
+            if (length < 4*sizeof(uint32_t) || read<uint32_t>() != astImageMagic) {
+                cout<<"Not an AST image."<<endl;
+                return nullptr;
+            }
+            if (read<uint32_t>() != astImageVersion) {
+                cout<<"Unsupported AST image version."<<endl;
+                return nullptr;
+            }
+            uint32_t stringsOffset = read<uint32_t>();
+            uint32_t stringCount = read<uint32_t>();
+            if (stringsOffset > length || !loadStrings(stringsOffset, stringCount)) {
+                cout<<"Corrupt AST image string table."<<endl;
+                return nullptr;
+            }
+            pos = 4*sizeof(uint32_t);
+            return dynamic_cast<ProgramStatement*>(node());
+        }
+        ProgramStatement* loadFile(string filename) {
+            int fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                cout<<"Couldn't open "<<filename<<endl;
+                return nullptr;
+            }
+            struct stat sb;
+            if (fstat(fd, &sb) < 0 || sb.st_size == 0) {
+                close(fd);
+                return nullptr;
+            }
+            void* mapping = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (mapping == MAP_FAILED) {
+                cout<<"Couldn't map "<<filename<<endl;
+                return nullptr;
+            }
+            ProgramStatement* ps = load((const char*)mapping, sb.st_size);
+            munmap(mapping, sb.st_size);
+            return ps;
+        }
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "../lexer.hpp"
+#include "../parser.hpp"
+#include "../parallelparser.hpp"
+#include "progen.hpp"
+using namespace std;
+
+/*
+    Measures how the lexer & parser scale with program size, and how deeply they can nest.
+    Each measurement runs in its own child process, so peak RSS is that run's alone and a
+    stack overflow while probing nesting depth only takes down the probe.
+
+    g++ -std=c++17 -O2 -pthread -o frontend bench/frontend.cpp
+    ./frontend [-n max statements] [-d depth] [-w width] [-s seed]
+    ./frontend -emit <statements> [-d depth] [-w width] [-s seed] > program.vp
+*/
+
+struct BenchOptions {
+    int maxStatements = 1000000;
+    int depth = 4;
+    int width = 4;
+    uint64_t seed = 42;
+    int emit = 0;
+};
+
+double seconds(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+//runs work in a child process, returning true if it exited cleanly
+bool isolated(function<void()> work) {
+    cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        work();
+        cout.flush();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void measure(int statements, BenchOptions& opts) {
+    ProgramGenerator gen(statements, opts.depth, opts.width, opts.seed);
+    string src = gen.generate();
+    Lexer lexer;
+    Parser parser;
+    auto start = chrono::steady_clock::now();
+    vector<Token> tokens = lexer.lex(src);
+    double lexTime = seconds(start);
+    size_t ntokens = tokens.size();
+    size_t before = memStats.get(MEM_AST).allocs;
+    start = chrono::steady_clock::now();
+    parser.parse(tokens);
+    double parseTime = seconds(start);
+    size_t nodes = memStats.get(MEM_AST).allocs - before;
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    cout<<right<<setw(10)<<statements<<setw(12)<<src.size()/1024<<setw(12)<<ntokens
+        <<setw(14)<<(long)(ntokens/lexTime)<<setw(12)<<nodes<<setw(14)<<(long)(nodes/parseTime)
+        <<setw(14)<<fixed<<setprecision(1)<<(lexTime+parseTime)*1e9/statements
+        <<setw(12)<<usage.ru_maxrss/1024<<defaultfloat<<endl;
+}
+
+//seconds taken by work, timed in a child process; negative if the child failed
+double isolatedTime(function<void()> work) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        return -1;
+    double elapsed = -1;
+    bool ok = isolated([&]() {
+        auto start = chrono::steady_clock::now();
+        work();
+        double t = seconds(start);
+        if (write(fds[1], &t, sizeof(t)) != sizeof(t))
+            _exit(1);
+    });
+    if (!ok || read(fds[0], &elapsed, sizeof(elapsed)) != sizeof(elapsed))
+        elapsed = -1;
+    close(fds[0]);
+    close(fds[1]);
+    return elapsed;
+}
+
+//lex & parse time of the largest program when split across 1, 2, 4.. threads
+void measureParallel(BenchOptions& opts) {
+    string src = ProgramGenerator(opts.maxStatements, opts.depth, opts.width, opts.seed).generate();
+    int cores = max((int)thread::hardware_concurrency(), 1);
+    double serial = 0;
+    cout<<right<<setw(10)<<"threads"<<setw(12)<<"ms"<<setw(12)<<"speedup"<<endl;
+    for (int threads = 1; threads <= cores; threads *= 2) {
+        double elapsed = isolatedTime([&]() { ParallelParser(threads).parse(src); });
+        if (threads == 1) serial = elapsed;
+        cout<<setw(10)<<threads<<setw(12)<<fixed<<setprecision(1)<<elapsed*1000
+            <<setw(12)<<setprecision(2)<<serial/elapsed<<defaultfloat<<endl;
+    }
+}
+
+//deepest nesting the frontend survives, doubling until a probe fails, then bisecting
+int maxDepth(function<string(int)> program, int limit) {
+    auto survives = [&](int levels) {
+        string src = program(levels);
+        return isolated([&]() {
+            Lexer lexer;
+            Parser parser;
+            vector<Token> tokens = lexer.lex(src);
+            parser.parse(tokens);
+        });
+    };
+    int good = 0, bad = 1;
+    while (bad <= limit && survives(bad)) {
+        good = bad;
+        bad *= 2;
+    }
+    if (bad > limit)
+        return good;
+    while (bad - good > 1) {
+        int mid = good + (bad - good) / 2;
+        if (survives(mid)) good = mid;
+        else bad = mid;
+    }
+    return good;
+}
+
+bool parseOptions(int argc, char* argv[], BenchOptions& opts) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (i+1 >= argc) return false;
+        if (arg == "-n") opts.maxStatements = atoi(argv[++i]);
+        else if (arg == "-d") opts.depth = atoi(argv[++i]);
+        else if (arg == "-w") opts.width = atoi(argv[++i]);
+        else if (arg == "-s") opts.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "-emit") opts.emit = atoi(argv[++i]);
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions opts;
+    if (!parseOptions(argc, argv, opts)) {
+        cout<<"usage: frontend [-n max statements] [-d depth] [-w width] [-s seed] [-emit statements]"<<endl;
+        return 1;
+    }
+    if (opts.emit > 0) {
+        ProgramGenerator(opts.emit, opts.depth, opts.width, opts.seed).generate(cout);
+        return 0;
+    }
+    cout<<"depth "<<opts.depth<<", width "<<opts.width<<", seed "<<opts.seed<<endl;
+    cout<<right<<setw(10)<<"stmts"<<setw(12)<<"KiB"<<setw(12)<<"tokens"<<setw(14)<<"tokens/s"
+        <<setw(12)<<"nodes"<<setw(14)<<"nodes/s"<<setw(14)<<"ns/stmt"<<setw(12)<<"peak MiB"<<endl;
+    for (int n = 1000; n <= opts.maxStatements; n *= 10) {
+        if (!isolated([&]() { measure(n, opts); }))
+            cout<<setw(10)<<n<<"  failed"<<endl;
+    }
+    measureParallel(opts);
+    //a flat ns/stmt column means linear scaling; growth down the column is the thing to look for
+    int limit = 1 << 22;
+    cout<<"max block nesting:      "<<maxDepth(ProgramGenerator::nestedBlocks, limit)<<endl;
+    cout<<"max expression nesting: "<<maxDepth(ProgramGenerator::nestedParens, limit)<<endl;
+    return 0;
+}
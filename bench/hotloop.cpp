@@ -0,0 +1,99 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "../lexer.hpp"
+#include "../parser.hpp"
+#include "../optimizer.hpp"
+#include "../typechecker.hpp"
+#include "../visitors.hpp"
+using namespace std;
+
+/*
+    Counts the heap allocations the interpreter makes while running arithmetic loops of
+    growing length. Every call to the global operator new is counted, not just the ones
+    memstats charges to a category, so a temporary string or vector made per iteration
+    shows up too. Passing Objects by reference and updating variables in place should
+    leave nothing to allocate once a loop is running: allocations per iteration, measured
+    as the difference between two loop lengths, must be zero. Exits 1 if they aren't.
+
+    g++ -std=c++17 -O2 -pthread -o hotloop bench/hotloop.cpp
+    ./hotloop [-n max iterations] [-O0]
+*/
+
+atomic<size_t> newCalls{0};
+
+//out of line, or gcc sees the malloc & free inside them paired with new & delete & warns
+__attribute__((noinline)) void* operator new(size_t sz) {
+    newCalls.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(sz ? sz : 1))
+        return p;
+    throw bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+struct LoopRun {
+    size_t allocs;
+    double seconds;
+};
+
+const char* loops[][2] = {
+    { "integers", "var s := 0; var i := 0; while (i < N) { s := s + i * 2 - 1; i := i + 1; };" },
+    { "doubles",  "var s := 0.5; var i := 0; while (i < N) { s := s + i * 0.5 - 1.5; i := i + 1; };" },
+    { "compare",  "var s := 0; var i := 0; while (i < N) { if (s < i) { s := s + 2; }; i := i + 1; };" }
+};
+
+//the allocations & time spent running one loop, leaving out lexing, parsing & optimizing
+LoopRun run(string src, long n, bool optimize) {
+    src.replace(src.find('N'), 1, to_string(n));
+    Lexer lexer;
+    Parser parser;
+    vector<Token> tokens = lexer.lex(src);
+    ProgramStatement* ast = parser.parse(tokens);
+    TypeChecker checker;
+    checker.visit(ast);
+    if (optimize) {
+        PassManager optimizer;
+        standardPipeline(optimizer).run(ast);
+    }
+    InterpreterVisitor iv;
+    size_t before = newCalls.load();
+    auto start = chrono::steady_clock::now();
+    iv.visit(ast);
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return LoopRun{ newCalls.load() - before, elapsed };
+}
+
+int main(int argc, char* argv[]) {
+    long maxIterations = 1000000;
+    bool optimize = true;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-n" && i+1 < argc) maxIterations = atol(argv[++i]);
+        else if (arg == "-O0") optimize = false;
+        else {
+            cout<<"usage: hotloop [-n max iterations] [-O0]"<<endl;
+            return 1;
+        }
+    }
+    bool flat = true;
+    cout<<left<<setw(10)<<"loop"<<right<<setw(12)<<"iterations"<<setw(12)<<"allocs"
+        <<setw(14)<<"allocs/iter"<<setw(12)<<"ns/iter"<<endl;
+    for (auto& loop : loops) {
+        LoopRun base = run(loop[1], 0, optimize);
+        for (long n = 1000; n <= maxIterations; n *= 10) {
+            LoopRun r = run(loop[1], n, optimize);
+            double perIteration = (double)(r.allocs - base.allocs) / n;
+            if (r.allocs != base.allocs)
+                flat = false;
+            cout<<left<<setw(10)<<loop[0]<<right<<setw(12)<<n<<setw(12)<<r.allocs
+                <<setw(14)<<fixed<<setprecision(4)<<perIteration
+                <<setw(12)<<setprecision(1)<<r.seconds*1e9/n<<defaultfloat<<endl;
+        }
+    }
+    cout<<(flat ? "allocations are constant in the number of iterations" : "loops allocate per iteration")<<endl;
+    return flat ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+#ifndef progen_hpp
+#define progen_hpp
+#include <iostream>
+#include <sstream>
+#include <cstdint>
+using namespace std;
+
+/*
+    Emits valid, terminating programs of a chosen shape for exercising the frontend:
+    'statements' statements in all, blocks nested up to 'depth' deep, and expressions
+    of 'width' operands. Every name an expression reads is a number, so programs also
+    pass the type checker. The same seed always produces the same program.
+*/
+class ProgramGenerator {
+    private:
+        int statements;
+        int depth;
+        int width;
+        uint64_t state;
+        int emitted;
+        int functions;
+        const static int vars = 8;
+        uint64_t next() {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+        int pick(int n) { return next() % n; }
+        void indent(ostream& os, int level) {
+            for (int i = 0; i < level; i++) os<<"  ";
+        }
+        void operand(ostream& os, const char* names[], int count) {
+            int kind = pick(4);
+            if (kind == 0) {
+                os<<pick(100);
+            } else if (kind == 1 && functions > 0) {
+                //only functions already defined are called, so nothing recurses
+                os<<"f"<<pick(functions)<<"(";
+                operand(os, names, count);
+                os<<", "<<pick(10)<<")";
+            } else {
+                os<<names[pick(count)];
+            }
+        }
+        void expression(ostream& os, const char* names[], int count) {
+            static const char* ops[] = { " + ", " - ", " * " };
+            int open = 0;
+            for (int i = 0; i < width; i++) {
+                if (i > 0) os<<ops[pick(3)];
+                if (i + 2 < width && pick(4) == 0) {
+                    os<<"(";
+                    open++;
+                }
+                operand(os, names, count);
+            }
+            while (open-- > 0) os<<")";
+        }
+        void expression(ostream& os) {
+            static const char* globals[] = { "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7" };
+            expression(os, globals, vars);
+        }
+        void block(ostream& os, int level, int budget) {
+            while (budget > 0 && emitted < statements) {
+                indent(os, level);
+                emitted++;
+                budget--;
+                int kind = pick(level < depth ? 6 : 3);
+                if (kind == 0) {
+                    os<<"println ";
+                    expression(os);
+                    os<<";\n";
+                } else if (kind < 3) {
+                    os<<"v"<<pick(vars)<<" := ";
+                    expression(os);
+                    os<<";\n";
+                } else {
+                    if (kind == 3) {
+                        os<<"for x"<<level<<" in [1, 2] {\n";
+                    } else {
+                        os<<"if (";
+                        expression(os);
+                        os<<" < "<<pick(1000)<<") {\n";
+                    }
+                    block(os, level + 1, 2 + pick(4));
+                    indent(os, level);
+                    os<<"};\n";
+                }
+            }
+        }
+    public:
+        ProgramGenerator(int n, int d = 4, int w = 4, uint64_t seed = 42)
+            : statements(n), depth(d), width(w < 1 ? 1 : w), state(seed ? seed : 1), emitted(0), functions(0) { }
+        void generate(ostream& os) {
+            emitted = 0;
+            functions = 0;
+            for (int i = 0; i < vars; i++) {
+                os<<"var v"<<i<<" := "<<i<<";\n";
+            }
+            static const char* params[] = { "a", "b" };
+            for (int i = 0; i < 4 && emitted < statements; i++, emitted++) {
+                os<<"def f"<<i<<"(var a, var b) { return ";
+                expression(os, params, 2);
+                os<<"; };\n";
+                functions++;
+            }
+            while (emitted < statements) {
+                block(os, 0, statements);
+            }
+        }
+        string generate() {
+            stringstream ss;
+            generate(ss);
+            return ss.str();
+        }
+        //one statement inside 'levels' nested if blocks
+        static string nestedBlocks(int levels) {
+            string src = "var v := 1;\n";
+            src.reserve(levels * 18 + 32);
+            for (int i = 0; i < levels; i++) src += "if (v < 2) { ";
+            src += "v := 2; ";
+            for (int i = 0; i < levels; i++) src += "}; ";
+            return src;
+        }
+        //one expression inside 'levels' nested parentheses
+        static string nestedParens(int levels) {
+            string src = "var v := ";
+            src.reserve(levels * 6 + 16);
+            for (int i = 0; i < levels; i++) src += "(1 + ";
+            src += "1";
+            for (int i = 0; i < levels; i++) src += ")";
+            src += ";\n";
+            return src;
+        }
+};
+
+#endif
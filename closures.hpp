@@ -0,0 +1,174 @@
+#ifndef closures_hpp
+#define closures_hpp
+#include <vector>
+#include <list>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include "syntaxtree.hpp"
+#include "optimizer.hpp"
+using namespace std;
+
+//Names a function body binds & reads, without looking inside the functions it defines
+class ScopeNames : public AssignedNames {
+    public:
+        unordered_set<string> reads;
+        list<FuncDefStatement*> defs;
+        bool yields = false;
+        void collect(FuncDefStatement* ds) {
+            if (ds->getParams() != nullptr) {
+                for (auto m : ds->getParams()->getParams()) {
+                    VarDefStatement* vd = dynamic_cast<VarDefStatement*>(m);
+                    if (vd != nullptr) writes[vd->getName()]++;
+                }
+            }
+            rewrite(ds->getBody());
+        }
+        void visit(FuncDefStatement* ds) override {
+            writes[ds->getName()]++;
+            defs.push_back(ds);
+        }
+        void visit(YieldStatement* ys) override {
+            yields = true;
+            TreeRewriter::visit(ys);
+        }
+        void visit(IdExpression* idexpr) override {
+            reads.insert(idexpr->getId());
+            result = idexpr;
+        }
+        void visit(IncrementExpression* inc) override {
+            reads.insert(inc->getTarget()->getId());
+            AssignedNames::visit(inc);
+        }
+        void visit(FunctionCall* fc) override {
+            if (fc->getName() != nullptr)
+                reads.insert(fc->getName()->getId());
+            TreeRewriter::visit(fc);
+        }
+};
+
+/*
+    Works out where every name a function reads lives, so closures can be flat.
+    A name a function binds is its own local. Any other name it reads, or that a function
+    nested in it reads without binding, is captured if a function enclosing it binds it,
+    & is otherwise a global. Captures are copied into the closure when its def runs, from
+    the definer's locals or from the definer's own captures, so a closure never holds on to
+    the scope it was made in, & reading a capture is an index into the closure's upvalues.
+    A def also fills in the captures of the siblings defined before it in the same body
+    that captured its name, so nested functions can call each other whichever comes first.
+    Reads of captured names are marked with their slot; everything else is left to be
+    looked up by name, first among the function's locals & then among the globals.
+*/
+class CaptureAnalysis {
+    private:
+        struct Scope {
+            unordered_set<string> bound;
+            unordered_set<string> free;
+            list<FuncDefStatement*> defs;
+        };
+        unordered_map<FuncDefStatement*, Scope> scopes;
+        //marks the reads in one body, leaving the bodies of functions it defines to their own pass
+        class SlotMarker : public TreeRewriter {
+            private:
+                unordered_map<string, int> slots;
+                void mark(IdExpression* idexpr) {
+                    auto it = slots.find(idexpr->getId());
+                    idexpr->setUpvalue(it != slots.end() ? it->second : -1);
+                }
+            public:
+                SlotMarker(const vector<Capture>& captures) {
+                    for (size_t i = 0; i < captures.size(); i++)
+                        slots[captures[i].name] = i;
+                }
+                void markBody(FuncDefStatement* ds) {
+                    rewrite(ds->getBody());
+                }
+                void visit(FuncDefStatement* ds) override { }
+                void visit(IdExpression* idexpr) override {
+                    mark(idexpr);
+                    result = idexpr;
+                }
+                void visit(IncrementExpression* inc) override {
+                    mark(inc->getTarget());
+                    result = inc;
+                }
+                void visit(FunctionCall* fc) override {
+                    if (fc->getName() != nullptr)
+                        mark(fc->getName());
+                    TreeRewriter::visit(fc);
+                }
+        };
+        //what ds binds, & what it & everything nested in it read without binding
+        Scope& scan(FuncDefStatement* ds) {
+            auto it = scopes.find(ds);
+            if (it != scopes.end())
+                return it->second;
+            ScopeNames names;
+            names.collect(ds);
+            Scope sc;
+            for (auto& w : names.writes)
+                sc.bound.insert(w.first);
+            sc.defs = std::move(names.defs);
+            for (auto& id : names.reads) {
+                if (!sc.bound.count(id)) sc.free.insert(id);
+            }
+            for (auto nested : sc.defs) {
+                for (auto& id : scan(nested).free) {
+                    if (!sc.bound.count(id)) sc.free.insert(id);
+                }
+            }
+            return scopes[ds] = std::move(sc);
+        }
+        //ds's captures are settled; mark its reads & settle the captures of what it defines
+        void resolve(FuncDefStatement* ds) {
+            SlotMarker marker(ds->getCaptures());
+            marker.markBody(ds);
+            unordered_map<string, int> slots;
+            for (size_t i = 0; i < ds->getCaptures().size(); i++)
+                slots[ds->getCaptures()[i].name] = i;
+            Scope& sc = scan(ds);
+            for (auto nested : sc.defs) {
+                //sorted, so the same function always lays its upvalues out the same way
+                set<string> names(scan(nested).free.begin(), scan(nested).free.end());
+                vector<Capture> captures;
+                for (auto& id : names) {
+                    if (sc.bound.count(id)) captures.push_back(Capture{id, -1});
+                    else if (slots.count(id)) captures.push_back(Capture{id, slots[id]});
+                }
+                nested->setCaptures(std::move(captures));
+                nested->clearForwards();
+            }
+            //defs are listed in source order, so only the later sibling can complete the earlier one
+            for (auto earlier = sc.defs.begin(); earlier != sc.defs.end(); earlier++) {
+                auto& captures = (*earlier)->getCaptures();
+                for (size_t k = 0; k < captures.size(); k++) {
+                    if (captures[k].from >= 0)
+                        continue;
+                    for (auto later = next(earlier); later != sc.defs.end(); later++) {
+                        if ((*later)->getName() != captures[k].name)
+                            continue;
+                        (*later)->addForward(ForwardCapture{*earlier, (int)k});
+                    }
+                }
+            }
+            for (auto nested : sc.defs) {
+                resolve(nested);
+            }
+        }
+    public:
+        //every function defined at the top level of ps, & everything nested in them
+        void run(ProgramStatement* ps) {
+            ScopeNames top;
+            ps->accept(&top);
+            for (auto ds : top.defs) {
+                ds->setCaptures(vector<Capture>());
+                resolve(ds);
+            }
+        }
+        //a function whose captures are already known, as one restored from a snapshot is
+        void run(FuncDefStatement* ds) {
+            resolve(ds);
+        }
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef compiled_hpp
+#define compiled_hpp
+#include <iostream>
+#include <cmath>
+#include "visitors.hpp"
+using namespace std;
+
+/*
+    Support for programs translated to C++ by CppEmitVisitor.
+    Compiled code works on the same Objects as the interpreter & borrows an interpreter
+    only to host the built-in functions, which are bound to its globals. Script functions
+    become natives, so built-ins like map() call straight back into compiled code.
+*/
+
+inline void setEntry(ObjectMap* map, const Object& key, const Object& value) {
+    if (key.type == NIL) cout<<"nil is not a valid map key."<<endl;
+    else map->set(key, value);
+}
+
+inline Object callValue(InterpreterVisitor& iv, const Object& callee, Object* args, int count) {
+    if (callee.type != FUNCTION) {
+        cout<<"Can't call "<<callee<<", it isn't a function."<<endl;
+        return Object();
+    }
+    return iv.call(callee.func, args, count);
+}
+
+//v[from:to:stride], with the bounds clamped as the interpreter clamps them
+inline Object takeSlice(const Object& ob, bool hasFrom, double from, bool hasTo, double to, bool hasStride, double stride) {
+    long length = sliceableLength(ob);
+    if (length < 0) {
+        cout<<"Can only slice vectors, arrays, slices & strings."<<endl;
+        return Object();
+    }
+    auto clamp = [length](double at) { long l = at; return l < 0 ? 0 : (l > length ? length : l); };
+    long first = hasFrom ? clamp(from) : 0;
+    long last = hasTo ? clamp(to) : length;
+    long step = hasStride ? (long)stride : 1;
+    if (step < 1) {
+        cout<<"Slice stride must be at least 1."<<endl;
+        return Object();
+    }
+    size_t count = last > first ? (last - first + step - 1) / step : 0;
+    return sliceOf(ob, first, count, step);
+}
+
+//steps through anything a for loop accepts; vectors are re-measured every step, as they may grow
+class Cursor {
+    private:
+        Object seq;
+        size_t at;
+    public:
+        Cursor(const Object& ob) : seq(ob), at(0) {
+            if (seq.type != VECTOR && seq.type != ARRAY && seq.type != SLICE && seq.type != SEQUENCE) {
+                cout<<"Can only iterate over vectors, arrays, slices & sequences."<<endl;
+                seq = Object();
+            }
+        }
+        bool next(InterpreterVisitor& iv, Object& out) {
+            switch (seq.type) {
+                case VECTOR:
+                    if (at >= seq.vec->size()) return false;
+                    out = (*seq.vec)[at++];
+                    return true;
+                case ARRAY:
+                    if (at >= seq.arr->size()) return false;
+                    out = Object((*seq.arr)[at++]);
+                    return true;
+                case SLICE:
+                    if (at >= seq.slice->size()) return false;
+                    out = seq.slice->get(at++);
+                    return true;
+                case SEQUENCE:
+                    return seq.seq->next(iv, out);
+                default: break;
+            }
+            return false;
+        }
+};
+
+//a 'memo def', compiled: body's results cached on its arguments just as the interpreter caches them
+template <Native body>
+Object memoized(InterpreterVisitor& iv, Object* args, int count) {
+    static MemoTable* memo = new MemoTable();
+    if (!MemoTable::cacheable(args, count))
+        return body(iv, args, count);
+    vector<Object> key(args, args + count);
+    Object cached;
+    if (memo->find(key, cached))
+        return cached;
+    Object result = body(iv, args, count);
+    memo->store(std::move(key), result);
+    return result;
+}
+
+#endif
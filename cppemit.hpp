@@ -0,0 +1,625 @@
+#ifndef cppemit_hpp
+#define cppemit_hpp
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <set>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "syntaxtree.hpp"
+#include "optimizer.hpp"
+#include "visitors.hpp"
+#include "closures.hpp"
+using namespace std;
+
+//Whether evaluating an expression can change a variable, so reads on either side of it must stay in order
+class SideEffects : public TreeRewriter {
+    public:
+        bool found = false;
+        void visit(AssignExpression* assign) override { found = true; result = assign; }
+        void visit(IncrementExpression* inc) override { found = true; result = inc; }
+        void visit(FunctionCall* fc) override { found = true; result = fc; }
+        static bool in(ExpressionNode* expr) {
+            SideEffects effects;
+            effects.rewrite(expr);
+            return effects.found;
+        }
+};
+
+/*
+    Translates a whole program into C++ that runs on the Object runtime with no tree to walk.
+    A program's top-level names become C++ globals and the names a function binds become its
+    locals, which is just how the interpreter resolves them. Programs with closures, which
+    capture an enclosing function's variables, or with generators are reported rather than
+    compiled.
+    Expressions are flattened into temporaries wherever a later operand has side effects, so
+    everything is still evaluated left to right, and whatever the type checker proved numeric
+    is computed on raw doubles or 64 bit integers.
+*/
+class CppEmitVisitor : public Visitor<> {
+    private:
+        enum Kind { K_OBJECT, K_NUMBER, K_BOOL, K_INTEGER };
+        struct Value {
+            string code;
+            Kind kind;
+            bool constant;
+        };
+        struct Scope {
+            FuncDefStatement* def;
+            string cname;
+            set<string> locals;
+            unordered_set<string> reads;
+        };
+        unordered_map<FuncDefStatement*, Scope> scopes;
+        list<FuncDefStatement*> order;
+        set<string> globals;
+        unordered_set<string> builtins;
+        unordered_map<string, string> direct;
+        unordered_set<string> cnames;
+        vector<string> literals;
+        unordered_map<string, size_t> literalIds;
+        Scope* scope = nullptr;
+        ostream* out = nullptr;
+        int depth = 0;
+        int temps = 0;
+        Value value;
+        void error(const string& where, const string& msg) {
+            errors.push_back("can't compile " + where + ": " + msg);
+        }
+        void line(const string& s) {
+            for (int i = 0; i < depth; i++)
+                *out<<"    ";
+            *out<<s<<"\n";
+        }
+        string temp(const char* prefix = "t") {
+            return prefix + to_string(temps++);
+        }
+        static string mangle(const string& name) {
+            string m;
+            for (unsigned char c : name) {
+                if (isalnum(c) || c == '_') m.push_back(c);
+                else m += "_" + to_string(c) + "_";
+            }
+            return m;
+        }
+        static string quote(string_view s) {
+            string q = "\"";
+            for (unsigned char c : s) {
+                if (c == '"' || c == '\\') {
+                    q.push_back('\\');
+                    q.push_back(c);
+                } else if (c < 32 || c > 126) {
+                    char esc[8];
+                    snprintf(esc, sizeof(esc), "\\%03o", c);
+                    q += esc;
+                } else q.push_back(c);
+            }
+            return q + "\"";
+        }
+        //the shortest decimal that reads back as exactly d
+        static string number(double d) {
+            if (std::isnan(d)) return "NAN";
+            if (std::isinf(d)) return d > 0 ? "HUGE_VAL" : "(-HUGE_VAL)";
+            char buf[32];
+            for (int precision = 15; precision <= 17; precision++) {
+                snprintf(buf, sizeof(buf), "%.*g", precision, d);
+                if (strtod(buf, nullptr) == d) break;
+            }
+            string s = buf;
+            if (s.find_first_of(".e") == string::npos)
+                s += ".0";
+            return s;
+        }
+        string var(const string& name) {
+            if (scope != nullptr && scope->locals.count(name))
+                return "l_" + mangle(name);
+            return "g_" + mangle(name);
+        }
+        string native(FuncDefStatement* ds) {
+            const string& cname = scopes[ds].cname;
+            return ds->isMemoized() ? "memoized<" + cname + ">" : cname;
+        }
+        static string obj(const Value& v) {
+            return v.kind == K_OBJECT ? v.code : "Object(" + v.code + ")";
+        }
+        static string num(const Value& v) {
+            if (v.kind == K_INTEGER) return "(double)" + v.code;
+            return v.kind == K_NUMBER ? v.code : "doubleOf(" + obj(v) + ")";
+        }
+        //only asked of values the type checker proved are integers
+        static string integer(const Value& v) {
+            return v.kind == K_INTEGER ? v.code : obj(v) + ".intval";
+        }
+        static Value constant(const Object& ob) {
+            //the most negative integer has no literal of its own
+            if (ob.type == INTEGER && ob.intval == INT64_MIN)
+                return Value{"INT64_MIN", K_INTEGER, true};
+            if (ob.type == INTEGER)
+                return Value{"INT64_C(" + to_string(ob.intval) + ")", K_INTEGER, true};
+            return Value{number(ob.numval), K_NUMBER, true};
+        }
+        static string truth(const Value& v) {
+            return v.kind == K_BOOL ? v.code : obj(v) + ".boolval";
+        }
+        Value eval(ExpressionNode* expr) {
+            value = Value{"Object()", K_OBJECT, true};
+            if (expr != nullptr)
+                expr->accept(this);
+            return value;
+        }
+        //fixes a value as it is now, before anything evaluated after it can change what it reads
+        Value spill(const Value& v) {
+            if (v.constant)
+                return v;
+            static const char* types[] = { "Object", "double", "bool", "int64_t" };
+            string t = temp();
+            line(string(types[v.kind]) + " " + t + " = " + v.code + ";");
+            return Value{t, v.kind, false};
+        }
+        vector<Value> evalInOrder(const vector<ExpressionNode*>& exprs) {
+            vector<bool> effectsAfter(exprs.size() + 1, false);
+            for (size_t i = exprs.size(); i > 0; i--)
+                effectsAfter[i-1] = effectsAfter[i] || SideEffects::in(exprs[i-1]);
+            vector<Value> vals;
+            for (size_t i = 0; i < exprs.size(); i++) {
+                Value v = eval(exprs[i]);
+                vals.push_back(effectsAfter[i+1] ? spill(v) : v);
+            }
+            return vals;
+        }
+        //evaluates expr into its own buffer, for a loop test that has to be computed inside the loop
+        Value capture(ExpressionNode* expr, ostringstream& buffer) {
+            ostream* saved = out;
+            out = &buffer;
+            depth++;
+            Value v = eval(expr);
+            depth--;
+            out = saved;
+            return v;
+        }
+        void block(StatementList* sl) {
+            depth++;
+            if (sl != nullptr)
+                sl->accept(this);
+            depth--;
+        }
+        string uniqueName(const string& name) {
+            string base = "f_" + mangle(name);
+            string cname = base;
+            for (int k = 2; cnames.count(cname); k++)
+                cname = base + "_" + to_string(k);
+            cnames.insert(cname);
+            return cname;
+        }
+        void analyze(ProgramStatement* ps) {
+            ScopeNames top;
+            ps->accept(&top);
+            if (top.yields)
+                error("the program", "yield outside of a generator");
+            ProgramBindings all;
+            ps->accept(&all);
+            InterpreterVisitor host;
+            for (auto& b : host.globals())
+                builtins.insert(b.first);
+            for (auto& w : top.writes)
+                globals.insert(w.first);
+            CaptureAnalysis().run(ps);
+            //every function, nested ones after the function defining them
+            list<FuncDefStatement*> pending = top.defs;
+            unordered_map<string, string> localOf;
+            while (!pending.empty()) {
+                FuncDefStatement* ds = pending.front();
+                pending.pop_front();
+                if (ds->isGenerator())
+                    error(ds->getName(), "generators can't be compiled");
+                if (!ds->getCaptures().empty())
+                    error(ds->getName(), "closures can't be compiled, and it captures '" + ds->getCaptures().front().name + "'");
+                ScopeNames names;
+                names.collect(ds);
+                Scope& sc = scopes[ds];
+                sc.def = ds;
+                sc.cname = uniqueName(ds->getName());
+                for (auto& w : names.writes) {
+                    sc.locals.insert(w.first);
+                    localOf.emplace(w.first, ds->getName());
+                }
+                sc.reads = std::move(names.reads);
+                order.push_back(ds);
+                pending.splice(pending.end(), names.defs);
+            }
+            //any other name a function reads is a global, or a capture, which was reported above
+            auto resolve = [&](const string& where, const string& id) {
+                if (!globals.count(id) && !builtins.count(id)) {
+                    error(where, "'" + id + "' is never bound");
+                    return;
+                }
+                globals.insert(id);
+            };
+            for (auto& id : top.reads) {
+                if (!top.writes.count(id))
+                    resolve("the program", id);
+            }
+            for (auto ds : order) {
+                for (auto& id : scopes[ds].reads) {
+                    if (!scopes[ds].locals.count(id) && ds->getCaptures().empty())
+                        resolve(ds->getName(), id);
+                }
+            }
+            //a function bound once, at the top level & never shadowed, is called without looking it up
+            for (auto ds : top.defs) {
+                if (all.writes[ds->getName()] == 1 && !localOf.count(ds->getName()))
+                    direct[ds->getName()] = native(ds);
+            }
+        }
+        void emitFunction(FuncDefStatement* ds) {
+            scope = &scopes[ds];
+            temps = 0;
+            line("static Object " + scope->cname + "(InterpreterVisitor& iv, Object* args, int count) {");
+            depth++;
+            set<string> bound;
+            int i = 0;
+            if (ds->getParams() != nullptr) {
+                for (auto m : ds->getParams()->getParams()) {
+                    VarDefStatement* vd = dynamic_cast<VarDefStatement*>(m);
+                    if (vd == nullptr || !bound.insert(vd->getName()).second) continue;
+                    line("Object " + var(vd->getName()) + " = count > " + to_string(i) + " ? args[" + to_string(i) + "] : Object();");
+                    i++;
+                }
+            }
+            //read before being bound, a local sees the global, as it does in the interpreter
+            for (auto& name : scope->locals) {
+                if (bound.count(name)) continue;
+                line("Object " + var(name) + (globals.count(name) ? " = g_" + mangle(name) : "") + ";");
+            }
+            ds->getBody()->accept(this);
+            //a body that runs off its end returns nil
+            auto& stmts = ds->getBody()->getStatements();
+            if (stmts.empty() || dynamic_cast<ReturnStatement*>(stmts.back()) == nullptr)
+                line("return Object();");
+            depth--;
+            line("}");
+            line("");
+            scope = nullptr;
+        }
+    public:
+        list<string> errors;
+        //writes the program as a C++ translation unit, or reports why it can't be compiled
+        bool emit(ProgramStatement* ps, ostream& os) {
+            errors.clear();
+            analyze(ps);
+            if (!errors.empty())
+                return false;
+            ostringstream body;
+            out = &body;
+            depth = 0;
+            for (auto ds : order)
+                emitFunction(ds);
+            temps = 0;
+            line("extern \"C\" int vp_run() {");
+            depth++;
+            line("InterpreterVisitor iv;");
+            for (auto& g : globals) {
+                if (builtins.count(g))
+                    line("g_" + mangle(g) + " = iv.globals()[" + quote(g) + "];");
+            }
+            ps->accept(this);
+            line("return 0;");
+            depth--;
+            line("}");
+            os<<"//Generated by CppEmitVisitor. Build with the interpreter's headers on the include path:\n"
+              <<"//  c++ -std=c++17 -O2 -I<interpreter source> -o program program.cpp\n"
+              <<"//or with -shared -fPIC -DVP_SHARED for a shared object exporting vp_run().\n"
+              <<"#include \"compiled.hpp\"\n\n";
+            for (size_t i = 0; i < literals.size(); i++)
+                os<<"static const Object k"<<i<<"(string("<<quote(literals[i])<<", "<<literals[i].size()<<"));\n";
+            for (auto& g : globals)
+                os<<"static Object g_"<<mangle(g)<<";\n";
+            for (auto ds : order)
+                os<<"static Object "<<scopes[ds].cname<<"(InterpreterVisitor& iv, Object* args, int count);\n";
+            os<<"\n"<<body.str()
+              <<"\n#ifndef VP_SHARED\nint main() {\n    return vp_run();\n}\n#endif\n";
+            return true;
+        }
+        void report(ostream& os) {
+            for (auto& msg : errors)
+                os<<msg<<endl;
+        }
+        void visit(ProgramStatement* ps) override {
+            ps->getStatement()->accept(this);
+        }
+        void visit(StatementList* sl) override {
+            for (auto m : sl->getStatements()) {
+                m->accept(this);
+            }
+        }
+        void visit(ParameterList* pl) override { }
+        void visit(PrintStatement* ps) override {
+            Value v = eval(ps->getExpression());
+            line("cout<<" + obj(v) + "<<endl;");
+        }
+        void visit(WhileStatement* ws) override {
+            ostringstream test;
+            Value t = capture(ws->getTestExpr(), test);
+            if (test.str().empty()) {
+                line("while (" + truth(t) + ") {");
+            } else {
+                line("while (true) {");
+                *out<<test.str();
+                line("    if (!" + truth(t) + ") break;");
+            }
+            block(ws->getLoopBody());
+            line("}");
+        }
+        void visit(ForStatement* fs) override {
+            Value seq = eval(fs->getIterable());
+            string cursor = temp("c");
+            line("Cursor " + cursor + "{" + obj(seq) + "};");
+            line("while (" + cursor + ".next(iv, " + var(fs->getVarName()) + ")) {");
+            block(fs->getLoopBody());
+            line("}");
+        }
+        void visit(IfStatement* is) override {
+            Value t = eval(is->getTest());
+            line("if (" + truth(t) + ") {");
+            block(is->getPassCase());
+            if (is->getFailCase() != nullptr) {
+                line("} else {");
+                block(is->getFailCase());
+            }
+            line("}");
+        }
+        void visit(FuncDefStatement* ds) override {
+            line(var(ds->getName()) + " = Object(new Function(" + quote(ds->getName()) + ", " + native(ds) + "));");
+        }
+        void visit(ReturnStatement* rs) override {
+            Value v = eval(rs->getRetVal());
+            line(scope != nullptr ? "return " + obj(v) + ";" : "return 0;");
+        }
+        void visit(YieldStatement* ys) override { }
+        void visit(VarDefStatement* vd) override {
+            line(var(vd->getName()) + " = Object();");
+            eval(vd->getExpr());
+        }
+        void visit(ExprStatement* es) override {
+            eval(es->getExpression());
+        }
+        void visit(IdExpression* idexpr) override {
+            value = Value{var(idexpr->getId()), K_OBJECT, false};
+        }
+        void visit(LiteralExpression* lit) override {
+            Environment none;
+            const Object& ob = lit->eval(none);
+            if (isNumber(ob)) {
+                value = constant(ob);
+            } else if (ob.type == BOOL) {
+                value = Value{ob.boolval ? "true" : "false", K_BOOL, true};
+            } else if (isText(ob)) {
+                string text(textOf(ob));
+                auto it = literalIds.find(text);
+                if (it == literalIds.end()) {
+                    it = literalIds.emplace(text, literals.size()).first;
+                    literals.push_back(text);
+                }
+                value = Value{"k" + to_string(it->second), K_OBJECT, true};
+            } else {
+                value = Value{"Object()", K_OBJECT, true};
+            }
+        }
+        void visit(AssignExpression* assign) override {
+            if (assign->getLeft()->getToken().type == TK_LBRACK) {
+                auto se = dynamic_cast<SubscriptExpression*>(assign->getLeft());
+                auto row = dynamic_cast<SubscriptExpression*>(se->getName());
+                if (row != nullptr) {
+                    vector<Value> v = evalInOrder({ row->getName(), row->getPosition(), se->getPosition(), assign->getRight() });
+                    line("storeElement(" + obj(v[0]) + ", " + obj(v[1]) + ", " + obj(v[2]) + ", " + obj(v[3]) + ");");
+                } else {
+                    vector<Value> v = evalInOrder({ se->getName(), se->getPosition(), assign->getRight() });
+                    line("storeElement(" + obj(v[0]) + ", " + obj(v[1]) + ", " + obj(v[2]) + ");");
+                }
+            } else {
+                Value v = eval(assign->getRight());
+                line(var(assign->getLeft()->getToken().lexeme) + " = " + obj(v) + ";");
+            }
+            value = Value{"Object()", K_OBJECT, true};
+        }
+        void visit(IncrementExpression* inc) override {
+            string x = var(inc->getTarget()->getId());
+            string d = constant(inc->getDelta()).code;
+            if (inc->getDelta().type == INTEGER)
+                line("if (" + x + ".type == INTEGER) " + x + ".intval = wrapAdd(" + x + ".intval, " + d + "); else " + x + " = add(" + x + ", Object(" + d + "));");
+            else
+                line("if (" + x + ".type == NUMBER) " + x + ".numval += " + d + "; else " + x + " = add(" + x + ", Object(" + d + "));");
+            value = Value{"Object()", K_OBJECT, true};
+        }
+        void visit(BinaryExpression* bin) override {
+            vector<Value> v = evalInOrder({ bin->getLeft(), bin->getRight() });
+            static const unordered_map<int, pair<string, string>> ops = {
+                { TK_PLUS, { "+", "add" } }, { TK_MINUS, { "-", "sub" } },
+                { TK_MULT, { "*", "mul" } }, { TK_DIV, { "/", "div" } }
+            };
+            static const unordered_map<int, string> wrapping = {
+                { TK_PLUS, "wrapAdd" }, { TK_MINUS, "wrapSub" }, { TK_MULT, "wrapMul" }
+            };
+            auto op = ops.find(bin->getToken().type);
+            if (op == ops.end()) {
+                value = v[0];
+            } else if (bin->getLeft()->isInteger() && bin->getRight()->isInteger()) {
+                auto w = wrapping.find(bin->getToken().type);
+                if (w != wrapping.end())
+                    value = Value{w->second + "(" + integer(v[0]) + ", " + integer(v[1]) + ")", K_INTEGER, false};
+                else
+                    value = Value{"(" + num(v[0]) + " / " + num(v[1]) + ")", K_NUMBER, false};
+            } else if (bin->getLeft()->isNumeric() && bin->getRight()->isNumeric()) {
+                value = Value{"(" + num(v[0]) + " " + op->second.first + " " + num(v[1]) + ")", K_NUMBER, false};
+            } else {
+                value = Value{op->second.second + "(" + obj(v[0]) + ", " + obj(v[1]) + ")", K_OBJECT, false};
+            }
+        }
+        void visit(RelOpExpression* rel) override {
+            vector<Value> v = evalInOrder({ rel->getLeft(), rel->getRight() });
+            static const unordered_map<int, pair<string, string>> ops = {
+                { TK_EQU, { "==", "eq" } }, { TK_NEQ, { "!=", "neq" } },
+                { TK_LT, { "<", "lt" } }, { TK_GT, { ">", "gt" } },
+                { TK_LTE, { "<=", "lte" } }, { TK_GTE, { ">=", "gte" } }
+            };
+            auto op = ops.find(rel->getToken().type);
+            if (op == ops.end()) {
+                value = v[0];
+            } else if (rel->getLeft()->isInteger() && rel->getRight()->isInteger()) {
+                value = Value{"(" + integer(v[0]) + " " + op->second.first + " " + integer(v[1]) + ")", K_BOOL, false};
+            } else if (rel->getLeft()->isNumeric() && rel->getRight()->isNumeric()) {
+                value = Value{"(" + num(v[0]) + " " + op->second.first + " " + num(v[1]) + ")", K_BOOL, false};
+            } else {
+                value = Value{op->second.second + "(" + obj(v[0]) + ", " + obj(v[1]) + ")", K_OBJECT, false};
+            }
+        }
+        //anything not proven a number is negated by the interpreter's own negative()
+        void visit(UnaryExpression* unary) override {
+            Value v = eval(unary->getLeft());
+            if (v.kind == K_NUMBER)
+                value = Value{"(-" + v.code + ")", K_NUMBER, false};
+            else if (v.kind == K_INTEGER)
+                value = Value{"wrapSub(0, " + v.code + ")", K_INTEGER, false};
+            else
+                value = Value{"negative(" + obj(v) + ")", K_OBJECT, false};
+        }
+        void visit(FunctionCall* fc) override {
+            const string& name = fc->getName()->getId();
+            bool known = direct.count(name) && !(scope != nullptr && scope->locals.count(name));
+            vector<ExpressionNode*> operands;
+            if (!known)
+                operands.push_back(fc->getName());
+            for (auto arg : fc->getArgs())
+                operands.push_back(arg);
+            vector<Value> v = evalInOrder(operands);
+            size_t first = known ? 0 : 1;
+            size_t count = v.size() - first;
+            string args = "nullptr";
+            if (count > 0) {
+                args = temp("a");
+                string init;
+                for (size_t i = first; i < v.size(); i++)
+                    init += (i > first ? ", " : "") + obj(v[i]);
+                line("Object " + args + "[] = { " + init + " };");
+            }
+            string t = temp();
+            string target = known ? direct[name] + "(iv, " : "callValue(iv, " + obj(v[0]) + ", ";
+            line("Object " + t + " = " + target + args + ", " + to_string(count) + ");");
+            value = Value{t, K_OBJECT, false};
+        }
+        void visit(ListExpression* le) override {
+            vector<ExpressionNode*> items(le->getExprsList().begin(), le->getExprsList().end());
+            vector<Value> v = evalInOrder(items);
+            string vec = temp("v");
+            line("ObjectVector* " + vec + " = new ObjectVector();");
+            if (!v.empty())
+                line(vec + "->reserve(" + to_string(v.size()) + ");");
+            for (auto& item : v)
+                line(vec + "->push_back(" + obj(item) + ");");
+            value = Value{"Object(" + vec + ")", K_OBJECT, false};
+        }
+        void visit(MapExpression* me) override {
+            vector<ExpressionNode*> parts;
+            for (auto& entry : me->getEntries()) {
+                parts.push_back(entry.first);
+                parts.push_back(entry.second);
+            }
+            vector<Value> v = evalInOrder(parts);
+            string map = temp("m");
+            line("ObjectMap* " + map + " = new ObjectMap(" + to_string(me->getEntries().size()) + ");");
+            for (size_t i = 0; i < v.size(); i += 2)
+                line("setEntry(" + map + ", " + obj(v[i]) + ", " + obj(v[i+1]) + ");");
+            value = Value{"Object(" + map + ")", K_OBJECT, false};
+        }
+        //m[i][j] reads in place, as the interpreter does
+        void visit(SubscriptExpression* se) override {
+            auto row = dynamic_cast<SubscriptExpression*>(se->getName());
+            if (row != nullptr) {
+                vector<Value> v = evalInOrder({ row->getName(), row->getPosition(), se->getPosition() });
+                value = Value{"subscript(" + obj(v[0]) + ", " + obj(v[1]) + ", " + obj(v[2]) + ")", K_OBJECT, false};
+                return;
+            }
+            vector<Value> v = evalInOrder({ se->getName(), se->getPosition() });
+            value = Value{"subscript(" + obj(v[0]) + ", " + obj(v[1]) + ")", K_OBJECT, false};
+        }
+        void visit(SliceExpression* se) override {
+            vector<ExpressionNode*> parts = { se->getName() };
+            for (auto bound : { se->getFrom(), se->getTo(), se->getStride() }) {
+                if (bound != nullptr) parts.push_back(bound);
+            }
+            vector<Value> v = evalInOrder(parts);
+            string code = "takeSlice(" + obj(v[0]);
+            size_t next = 1;
+            for (auto bound : { se->getFrom(), se->getTo(), se->getStride() }) {
+                if (bound != nullptr) code += ", true, " + num(v[next++]);
+                else code += ", false, 0";
+            }
+            value = Value{code + ")", K_OBJECT, false};
+        }
+};
+
+/*
+    Builds a program into a native executable, or a shared object if the output ends in .so,
+    by writing it out as C++ next to the output and running the system compiler on it.
+    The generated code includes the interpreter's headers, which are looked for in $VP_HOME,
+    or else in the directory holding the running executable. $CXX picks the compiler.
+*/
+class NativeCompiler {
+    private:
+        static string shellQuote(const string& s) {
+            string q = "'";
+            for (char c : s) {
+                if (c == '\'') q += "'\\''";
+                else q.push_back(c);
+            }
+            return q + "'";
+        }
+        static string headerDir() {
+            const char* home = getenv("VP_HOME");
+            if (home != nullptr)
+                return home;
+            char path[4096];
+            ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+            if (len <= 0)
+                return ".";
+            string exe(path, len);
+            size_t slash = exe.rfind('/');
+            return slash == string::npos ? "." : exe.substr(0, slash);
+        }
+    public:
+        bool writeSource(ProgramStatement* ps, const string& filename) {
+            CppEmitVisitor emitter;
+            ostringstream source;
+            if (!emitter.emit(ps, source)) {
+                emitter.report(cout);
+                return false;
+            }
+            ofstream out(filename);
+            if (!out) {
+                cout<<"Couldn't open "<<filename<<endl;
+                return false;
+            }
+            out<<source.str();
+            return (bool)out;
+        }
+        bool build(ProgramStatement* ps, const string& output) {
+            string source = output + ".cpp";
+            if (!writeSource(ps, source))
+                return false;
+            bool shared = output.size() > 3 && output.compare(output.size() - 3, 3, ".so") == 0;
+            const char* cxx = getenv("CXX");
+            string cmd = string(cxx != nullptr ? cxx : "c++") + " -std=c++17 -O2 " +
+                         (shared ? "-shared -fPIC -DVP_SHARED " : "") +
+                         "-I" + shellQuote(headerDir()) + " -o " + shellQuote(output) + " " + shellQuote(source);
+            if (system(cmd.c_str()) != 0) {
+                cout<<"Couldn't build "<<output<<" from "<<source<<endl;
+                return false;
+            }
+            return true;
+        }
+};
+
+#endif
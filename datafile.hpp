@@ -0,0 +1,186 @@
+#ifndef datafile_hpp
+#define datafile_hpp
+#include <iostream>
+#include <vector>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "object.hpp"
+using namespace std;
+
+/*
+    Loads numeric data from local files, without the lexer ever seeing it.
+    A binary file of native doubles is mapped & used in place as an array: nothing is read
+    until an element is touched. Text is mapped too, and parsed number by number straight
+    into one unboxed buffer per column, so there is never a copy of the text, a token, or
+    an Object per element.
+*/
+class DataLoader {
+    private:
+        struct Mapping {
+            char* data = nullptr;
+            size_t size = 0;
+            bool ok = false;
+        };
+        //writable mappings are private, so stores copy the page rather than reaching the file
+        Mapping map(const string& filename, bool writable) {
+            Mapping m;
+            int fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                cout<<"Couldn't open "<<filename<<endl;
+                return m;
+            }
+            struct stat sb;
+            if (fstat(fd, &sb) < 0) {
+                close(fd);
+                cout<<"Couldn't open "<<filename<<endl;
+                return m;
+            }
+            m.size = sb.st_size;
+            m.ok = true;
+            if (m.size > 0) {
+                int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+                void* mapping = mmap(nullptr, m.size, prot, MAP_PRIVATE, fd, 0);
+                if (mapping == MAP_FAILED) {
+                    cout<<"Couldn't map "<<filename<<endl;
+                    m.ok = false;
+                } else {
+                    m.data = (char*)mapping;
+                }
+            }
+            close(fd);
+            return m;
+        }
+        void unmap(Mapping& m) {
+            if (m.data != nullptr)
+                munmap(m.data, m.size);
+            m.data = nullptr;
+        }
+        static bool blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+        //parses one number, returning where it ends, or nullptr if there isn't one
+        static const char* number(const char* p, const char* end, double& out) {
+            if (p < end && *p == '+') p++;
+            auto res = from_chars(p, end, out);
+            return res.ec == errc() ? res.ptr : nullptr;
+        }
+        //a whole csv field, surrounding blanks allowed; empty fields are missing values
+        static bool field(const char* p, const char* end, double& out) {
+            while (p < end && blank(*p)) p++;
+            while (end > p && blank(end[-1])) end--;
+            out = NAN;
+            if (p == end) return true;
+            if (number(p, end, out) == end)
+                return true;
+            out = NAN;
+            return false;
+        }
+        //each ',' separated field of [p, end), pushed onto out
+        static void split(const char* p, const char* end, vector<pair<const char*, const char*>>& out) {
+            out.clear();
+            while (true) {
+                const char* comma = (const char*)memchr(p, ',', end - p);
+                const char* stop = comma ? comma : end;
+                out.emplace_back(p, stop);
+                if (!comma) break;
+                p = comma + 1;
+            }
+        }
+    public:
+        //a file of native-endian doubles, mapped & used in place
+        NumArray* mapDoubles(const string& filename) {
+            Mapping m = map(filename, true);
+            if (!m.ok)
+                return nullptr;
+            if (m.size % sizeof(double) != 0) {
+                cout<<filename<<" is not a whole number of doubles."<<endl;
+                unmap(m);
+                return nullptr;
+            }
+            //the mapping lives as long as the array, which like every object is never freed
+            return new NumArray((double*)m.data, m.size / sizeof(double));
+        }
+        //numbers separated by newlines or any other blanks
+        NumArray* readNumbers(const string& filename) {
+            Mapping m = map(filename, false);
+            if (!m.ok)
+                return nullptr;
+            madvise(m.data, m.size, MADV_SEQUENTIAL);
+            DoubleVector values;
+            const char* p = m.data;
+            const char* end = m.data + m.size;
+            int line = 1;
+            while (p < end) {
+                if (*p == '\n') {
+                    line++;
+                    p++;
+                } else if (blank(*p)) {
+                    p++;
+                } else {
+                    double d;
+                    const char* last = number(p, end, d);
+                    if (last == nullptr || (last < end && !blank(*last) && *last != '\n')) {
+                        cout<<filename<<":"<<line<<": not a number."<<endl;
+                        unmap(m);
+                        return nullptr;
+                    }
+                    values.push_back(d);
+                    p = last;
+                }
+            }
+            unmap(m);
+            return new NumArray(std::move(values));
+        }
+        //a vector holding an array per column; a first line that isn't all numbers is taken as a header
+        ObjectVector* readCSV(const string& filename) {
+            Mapping m = map(filename, false);
+            if (!m.ok)
+                return nullptr;
+            madvise(m.data, m.size, MADV_SEQUENTIAL);
+            vector<DoubleVector> columns;
+            vector<pair<const char*, const char*>> fields;
+            const char* p = m.data;
+            const char* end = m.data + m.size;
+            bool first = true;
+            size_t bad = 0;
+            while (p < end) {
+                const char* nl = (const char*)memchr(p, '\n', end - p);
+                const char* stop = nl ? nl : end;
+                const char* q = p;
+                while (q < stop && blank(*q)) q++;
+                if (q < stop) {
+                    split(p, stop, fields);
+                    if (first) {
+                        columns.resize(fields.size());
+                    }
+                    size_t misses = 0;
+                    for (size_t i = 0; i < columns.size(); i++) {
+                        double d = NAN;
+                        if (i < fields.size() && !field(fields[i].first, fields[i].second, d))
+                            misses++;
+                        columns[i].push_back(d);
+                    }
+                    if (first && misses > 0) {
+                        for (auto& col : columns) col.clear();
+                    } else {
+                        bad += misses;
+                    }
+                    first = false;
+                }
+                p = stop + 1;
+            }
+            unmap(m);
+            if (bad > 0)
+                cout<<filename<<": "<<bad<<" fields weren't numbers, read as nan."<<endl;
+            ObjectVector* result = new ObjectVector();
+            for (auto& col : columns) {
+                result->push_back(Object(new NumArray(std::move(col))));
+            }
+            return result;
+        }
+};
+
+#endif
@@ -2,15 +2,36 @@
 #define lexer_hpp
 #include <iostream>
 #include <vector>
-#include <unordered_map>
 #include "token.hpp"
 using namespace std;
 
+enum CharClass {
+    CC_OTHER = 0, CC_DIGIT = 1, CC_ALPHA = 2, CC_SPACE = 4
+};
+
+//one lookup classifies a character, instead of a chain of isalpha()/isdigit() calls
+struct CharTable {
+    unsigned char cls[256];
+    constexpr CharTable() : cls() {
+        for (int c = '0'; c <= '9'; c++) cls[c] = CC_DIGIT;
+        for (int c = 'a'; c <= 'z'; c++) cls[c] = CC_ALPHA;
+        for (int c = 'A'; c <= 'Z'; c++) cls[c] = CC_ALPHA;
+        cls[(unsigned char)'_'] = CC_ALPHA;
+        cls[(unsigned char)' '] = CC_SPACE;
+        cls[(unsigned char)'\t'] = CC_SPACE;
+        cls[(unsigned char)'\r'] = CC_SPACE;
+        cls[(unsigned char)'\n'] = CC_SPACE;
+    }
+    bool is(char c, int mask) const { return cls[(unsigned char)c] & mask; }
+};
+
+inline constexpr CharTable charTable;
+
 class Lexer {
     private:
-        unordered_map<string, Token> reserved;
         const static char eolChar = 0x7e;
-        string input;
+        const char* input;
+        int length;
         int spos;
         vector<Token> tokens;
         char advance() {
@@ -18,7 +39,7 @@ class Lexer {
             return get();
         }
         char get() {
-            if (spos < 0 || spos >= input.size())
+            if (spos < 0 || spos >= length)
                 return eolChar;
             return input[spos];
         }
@@ -27,56 +48,82 @@ class Lexer {
             return get();
         }
         bool done() {
-            return get() == eolChar;
+            return spos >= length;
+        }
+        //length of the run of characters matching mask, starting at from
+        int scan(int from, int mask) {
+            int i = from;
+            while (i < length && charTable.is(input[i], mask))
+                i++;
+            return i - from;
         }
+        //a literal without a decimal point is an integer, unless it's too big for 64 bits
         Token extractNumber() {
-            string lexeme;
-            while (isdigit(get())) {
-                lexeme.push_back(get());
-                advance();
+            int start = spos;
+            spos += scan(spos, CC_DIGIT);
+            if (spos + 1 < length && input[spos] == '.' && charTable.is(input[spos+1], CC_DIGIT)) {
+                spos++;
+                spos += scan(spos, CC_DIGIT);
+                return Token(TK_NUMBER, string(input + start, spos - start));
             }
-            if (get() == '.' && isdigit(advance())) {
-                lexeme.push_back('.');
-            }
-            while (isdigit(get())) {
-                lexeme.push_back(get());
-                advance();
-            }
-            return Token(TK_NUMBER, lexeme);
+            string digits(input + start, spos - start);
+            size_t lead = digits.find_first_not_of('0');
+            size_t width = lead == string::npos ? 0 : digits.size() - lead;
+            bool fits = width < 19 || (width == 19 && digits.compare(lead, 19, "9223372036854775807") <= 0);
+            return Token(fits ? TK_INTEGER : TK_NUMBER, std::move(digits));
         }
         Token extractIdentifier() {
-            string lexeme;
-            while (!done()) {
-                if (isalpha(get()) || isdigit(get()) || get() == '_') {
-                    lexeme.push_back(get());
-                    advance();
-                } else break;
-            }
-            return checkReserved(lexeme);
+            int start = spos;
+            spos += scan(spos, CC_ALPHA|CC_DIGIT);
+            return checkReserved(input + start, spos - start);
         }
         Token extractString() {
+            int start = ++spos;
+            while (spos < length && input[spos] != '\"')
+                spos++;
+            Token tk(TK_STRING, string(input + start, spos - start));
             advance();
-            string lexeme;
-            while (!done()) {
-                if (get() != '\"') lexeme.push_back(get());
-                else break;
-                advance();
-            }
-            return Token(TK_STRING, lexeme);
+            return tk;
         }
-        Token checkReserved(string lexeme) {
-            if (reserved.find(lexeme) != reserved.end()) {
-                return reserved[lexeme];
+        //keywords are resolved by length & first character, so no hashing or map probes
+        static Token checkReserved(const char* str, int len) {
+            auto is = [&](const char* kw) { return string::traits_type::compare(str, kw, len) == 0; };
+            switch (len) {
+                case 2:
+                    if (str[0] == 'i' && is("if")) return Token(TK_IF, "if");
+                    if (str[0] == 'i' && is("in")) return Token(TK_IN, "in");
+                    break;
+                case 3:
+                    if (str[0] == 'f' && is("for")) return Token(TK_FOR, "for");
+                    if (str[0] == 'd' && is("def")) return Token(TK_DEFINE, "def");
+                    if (str[0] == 'v' && is("var")) return Token(TK_VAR, "var");
+                    break;
+                case 4:
+                    if (str[0] == 'e' && is("else")) return Token(TK_ELSE, "else");
+                    if (str[0] == 't' && is("true")) return Token(TK_TRUE, "true");
+                    if (str[0] == 'm' && is("memo")) return Token(TK_MEMO, "memo");
+                    break;
+                case 5:
+                    if (str[0] == 'w' && is("while")) return Token(TK_WHILE, "while");
+                    if (str[0] == 'f' && is("false")) return Token(TK_FALSE, "false");
+                    if (str[0] == 'y' && is("yield")) return Token(TK_YIELD, "yield");
+                    break;
+                case 6: if (is("return")) return Token(TK_RETURN, "return"); break;
+                case 7: if (is("println")) return Token(TK_PRINT, "println"); break;
+                default: break;
             }
-            return Token(TK_ID, lexeme);
+            return Token(TK_ID, string(str, len));
         }
         Token checkSpecials() {
             switch (get()) {
-                case ':': 
-                    if (advance() == '=') {
+                case ':': {
+                    advance();
+                    if (get() == '=') {
                         return Token(TK_ASSIGN, ":=");
                     }
-                break;
+                    rewind();
+                    return Token(TK_COLON, ":");
+                } break;
                 case '(': return Token(TK_LPAREN, "(");
                 case ')': return Token(TK_RPAREN, ")");
                 case '{': return Token(TK_LCURLY, "{");
@@ -127,35 +174,29 @@ class Lexer {
             return Token(TK_ERR, "error");
         }
         void skipWhiteSpace() {
-            while (!done()) {
-                if (get() == ' ' || get() == '\t' || get() == '\r' || get() == '\n')
-                    advance();
-                else break;
-            }
+            spos += scan(spos, CC_SPACE);
         }
-        void init(string line) {
-            input = line;
+        void init(const char* src, int len) {
+            input = src;
+            length = len;
             spos = 0;
             tokens.clear();
+            tokens.reserve(length/4 + 1);
         }
     public:
-        Lexer() {
-            reserved["println"] = Token(TK_PRINT, "println");
-            reserved["while"] = Token(TK_WHILE, "while");
-            reserved["true"] = Token(TK_TRUE, "true");
-            reserved["false"] = Token(TK_FALSE, "false");
-            reserved["if"] = Token(TK_IF, "if");
-            reserved["else"] = Token(TK_ELSE, "else");
-            reserved["def"] = Token(TK_DEFINE, "def");
-            reserved["return"] = Token(TK_RETURN, "return");
-            reserved["var"] = Token(TK_VAR, "var");
+        Lexer() : input(nullptr), length(0), spos(0) { }
+        vector<Token> lex(const string& line) {
+            return lex(line.data(), line.size());
         }
-        vector<Token> lex(string line) {
-            init(line);
+        //lexes len characters in place, so a slice of a larger source needn't be copied out
+        vector<Token> lex(const char* src, int len) {
+            init(src, len);
             while (!done()) {
                 skipWhiteSpace();
-                if (isdigit(get())) tokens.push_back(extractNumber());
-                else if (isalpha(get()) || get() == '_') { tokens.push_back(extractIdentifier()); }
+                if (done()) break;
+                int cls = charTable.cls[(unsigned char)input[spos]];
+                if (cls == CC_DIGIT) tokens.push_back(extractNumber());
+                else if (cls == CC_ALPHA) { tokens.push_back(extractIdentifier()); }
                 else if (get() == '\"') { tokens.push_back(extractString()); }
                 else {
                     tokens.push_back(checkSpecials());
@@ -163,7 +204,7 @@ class Lexer {
                 }
             }
             tokens.push_back(Token(TK_EOF, "<eof>"));
-            return tokens;
+            return std::move(tokens);
         }
 };
 
@@ -0,0 +1,134 @@
+#ifndef matrix_hpp
+#define matrix_hpp
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include "memstats.hpp"
+using namespace std;
+
+/*
+    Kernels work a vector register of doubles at a time where the compiler offers vector
+    types: four lanes with AVX, two with SSE2 or NEON. Loads & stores go through memcpy, so
+    rows need no particular alignment. Elsewhere they fall back to one double at a time.
+*/
+#if defined(__GNUC__)
+#if defined(__AVX__)
+typedef double Lanes __attribute__((vector_size(32)));
+#else
+typedef double Lanes __attribute__((vector_size(16)));
+#endif
+const size_t laneCount = sizeof(Lanes) / sizeof(double);
+inline Lanes loadLanes(const double* p) { Lanes v; memcpy(&v, p, sizeof(v)); return v; }
+inline void storeLanes(double* p, Lanes v) { memcpy(p, &v, sizeof(v)); }
+inline Lanes splat(double d) { Lanes v; for (size_t i = 0; i < laneCount; i++) v[i] = d; return v; }
+#else
+typedef double Lanes;
+const size_t laneCount = 1;
+inline Lanes loadLanes(const double* p) { return *p; }
+inline void storeLanes(double* p, Lanes v) { *p = v; }
+inline Lanes splat(double d) { return d; }
+#endif
+
+/*
+    A dense matrix of doubles, stored row-major in one buffer, so m[i][j] is a multiply & an
+    add away and a whole row is contiguous. Products are computed in blocks sized to stay in
+    cache: each block of rows of the left operand is run against a block of rows of the right
+    one, with the innermost loop streaming along a row of each, a vector register at a time.
+*/
+class Matrix : public Tracked<MEM_VECTOR> {
+    private:
+        size_t nrows;
+        size_t ncols;
+        vector<double, TrackingAllocator<double, MEM_VECTOR>> cells;
+        static const size_t blockRows = 64;
+        static const size_t blockDepth = 128;
+        static const size_t blockCols = 256;
+        static const size_t tile = 32;
+        //c[0..n) += a * b[0..n)
+        static void axpy(double* c, const double* b, double a, size_t n) {
+            Lanes av = splat(a);
+            size_t j = 0;
+            for (; j + 2*laneCount <= n; j += 2*laneCount) {
+                storeLanes(c + j, loadLanes(c + j) + av * loadLanes(b + j));
+                storeLanes(c + j + laneCount, loadLanes(c + j + laneCount) + av * loadLanes(b + j + laneCount));
+            }
+            for (; j < n; j++)
+                c[j] += a * b[j];
+        }
+    public:
+        Matrix(size_t rows, size_t cols, double fill = 0) : nrows(rows), ncols(cols), cells(rows * cols, fill) { }
+        size_t rows() const { return nrows; }
+        size_t cols() const { return ncols; }
+        size_t size() const { return cells.size(); }
+        double& at(size_t i, size_t j) { return cells[i * ncols + j]; }
+        double* row(size_t i) { return cells.data() + i * ncols; }
+        double* begin() { return cells.data(); }
+        double* end() { return cells.data() + cells.size(); }
+        bool sameShape(const Matrix& other) const { return nrows == other.nrows && ncols == other.ncols; }
+        //this times other, or nullptr if the inner dimensions differ
+        Matrix* multiply(Matrix& other) {
+            if (ncols != other.nrows)
+                return nullptr;
+            Matrix* product = new Matrix(nrows, other.ncols);
+            size_t depth = ncols, width = other.ncols;
+            for (size_t i0 = 0; i0 < nrows; i0 += blockRows) {
+                size_t i1 = min(i0 + blockRows, nrows);
+                for (size_t k0 = 0; k0 < depth; k0 += blockDepth) {
+                    size_t k1 = min(k0 + blockDepth, depth);
+                    for (size_t j0 = 0; j0 < width; j0 += blockCols) {
+                        size_t n = min(j0 + blockCols, width) - j0;
+                        for (size_t i = i0; i < i1; i++) {
+                            double* out = product->row(i) + j0;
+                            const double* lhs = row(i);
+                            for (size_t k = k0; k < k1; k++)
+                                axpy(out, other.row(k) + j0, lhs[k], n);
+                        }
+                    }
+                }
+            }
+            return product;
+        }
+        //copied a tile at a time, so reads & writes both stay within a few cache lines
+        Matrix* transposed() {
+            Matrix* t = new Matrix(ncols, nrows);
+            for (size_t i0 = 0; i0 < nrows; i0 += tile) {
+                size_t i1 = min(i0 + tile, nrows);
+                for (size_t j0 = 0; j0 < ncols; j0 += tile) {
+                    size_t j1 = min(j0 + tile, ncols);
+                    for (size_t i = i0; i < i1; i++) {
+                        for (size_t j = j0; j < j1; j++)
+                            t->at(j, i) = at(i, j);
+                    }
+                }
+            }
+            return t;
+        }
+        //op applied element by element to two matrices of the same shape
+        template <class Op> static Matrix* zip(Matrix& lhs, Matrix& rhs, Op op) {
+            Matrix* out = new Matrix(lhs.nrows, lhs.ncols);
+            const double* a = lhs.begin();
+            const double* b = rhs.begin();
+            double* c = out->begin();
+            size_t n = out->size(), i = 0;
+            for (; i + laneCount <= n; i += laneCount)
+                storeLanes(c + i, op(loadLanes(a + i), loadLanes(b + i)));
+            for (; i < n; i++)
+                c[i] = op(a[i], b[i]);
+            return out;
+        }
+        //op applied to every element & a number, which is the left operand if scalarFirst
+        template <class Op> static Matrix* scale(Matrix& m, double scalar, bool scalarFirst, Op op) {
+            Matrix* out = new Matrix(m.nrows, m.ncols);
+            const double* a = m.begin();
+            double* c = out->begin();
+            Lanes sv = splat(scalar);
+            size_t n = out->size(), i = 0;
+            for (; i + laneCount <= n; i += laneCount)
+                storeLanes(c + i, scalarFirst ? op(sv, loadLanes(a + i)) : op(loadLanes(a + i), sv));
+            for (; i < n; i++)
+                c[i] = scalarFirst ? op(scalar, a[i]) : op(a[i], scalar);
+            return out;
+        }
+};
+
+#endif
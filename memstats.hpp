@@ -0,0 +1,128 @@
+#ifndef memstats_hpp
+#define memstats_hpp
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <new>
+using namespace std;
+
+enum MemCategory {
+    MEM_AST, MEM_STRING, MEM_VECTOR, MEM_MAP, MEM_FUNCTION, MEM_ENVIRONMENT, MEM_SEQUENCE, MEM_CATEGORIES
+};
+
+inline string memCategoryStr[] = {
+    "ast", "strings", "vectors", "maps", "functions", "environments", "sequences"
+};
+
+struct MemCounter {
+    size_t allocs;
+    size_t frees;
+    size_t bytes;
+    size_t peak;
+    size_t total;
+};
+
+//Allocation counters per category, cheap enough to leave on in production
+class MemStats {
+    private:
+        struct Counter {
+            atomic<size_t> allocs{0};
+            atomic<size_t> frees{0};
+            atomic<size_t> bytes{0};
+            atomic<size_t> peak{0};
+            atomic<size_t> total{0};
+        };
+        Counter counters[MEM_CATEGORIES];
+        atomic<size_t> liveBytes{0};
+        atomic<size_t> peakBytes{0};
+        static void raise(atomic<size_t>& peak, size_t now) {
+            size_t prev = peak.load(memory_order_relaxed);
+            while (now > prev && !peak.compare_exchange_weak(prev, now, memory_order_relaxed));
+        }
+    public:
+        void allocated(MemCategory cat, size_t sz) {
+            Counter& c = counters[cat];
+            c.allocs.fetch_add(1, memory_order_relaxed);
+            c.total.fetch_add(sz, memory_order_relaxed);
+            raise(c.peak, c.bytes.fetch_add(sz, memory_order_relaxed) + sz);
+            raise(peakBytes, liveBytes.fetch_add(sz, memory_order_relaxed) + sz);
+        }
+        void released(MemCategory cat, size_t sz) {
+            Counter& c = counters[cat];
+            c.frees.fetch_add(1, memory_order_relaxed);
+            c.bytes.fetch_sub(sz, memory_order_relaxed);
+            liveBytes.fetch_sub(sz, memory_order_relaxed);
+        }
+        MemCounter get(MemCategory cat) const {
+            const Counter& c = counters[cat];
+            return { c.allocs.load(), c.frees.load(), c.bytes.load(), c.peak.load(), c.total.load() };
+        }
+        size_t live() const { return liveBytes.load(); }
+        size_t peak() const { return peakBytes.load(); }
+        void reset() {
+            for (Counter& c : counters) {
+                c.allocs = 0; c.frees = 0; c.total = 0;
+                c.peak = c.bytes.load();
+            }
+            peakBytes = liveBytes.load();
+        }
+        void report(ostream& os) const {
+            os<<left<<setw(14)<<"category"<<right<<setw(12)<<"allocs"<<setw(12)<<"frees"
+              <<setw(14)<<"live bytes"<<setw(14)<<"peak bytes"<<setw(16)<<"total bytes"<<endl;
+            for (int i = 0; i < MEM_CATEGORIES; i++) {
+                MemCounter c = get((MemCategory)i);
+                os<<left<<setw(14)<<memCategoryStr[i]<<right<<setw(12)<<c.allocs<<setw(12)<<c.frees
+                  <<setw(14)<<c.bytes<<setw(14)<<c.peak<<setw(16)<<c.total<<endl;
+            }
+            os<<"live: "<<live()<<" bytes, peak: "<<peak()<<" bytes"<<endl;
+        }
+};
+
+inline MemStats memStats;
+
+//Standard allocator that charges everything it hands out to a category
+template <class T, MemCategory C>
+struct TrackingAllocator {
+    typedef T value_type;
+    template <class U> struct rebind { typedef TrackingAllocator<U, C> other; };
+    TrackingAllocator() noexcept { }
+    template <class U> TrackingAllocator(const TrackingAllocator<U, C>&) noexcept { }
+    T* allocate(size_t n) {
+        memStats.allocated(C, n*sizeof(T));
+        return static_cast<T*>(::operator new(n*sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) {
+        memStats.released(C, n*sizeof(T));
+        ::operator delete(p, n*sizeof(T));
+    }
+};
+
+template <class T, class U, MemCategory C>
+bool operator==(const TrackingAllocator<T, C>&, const TrackingAllocator<U, C>&) { return true; }
+
+template <class T, class U, MemCategory C>
+bool operator!=(const TrackingAllocator<T, C>&, const TrackingAllocator<U, C>&) { return false; }
+
+/*
+    Class-level operator new/delete for types that are always heap allocated.
+    operator new is kept out of line: inlined, gcc sees ::operator new paired with this
+    class's operator delete wherever a constructor might throw, & warns they mismatch.
+*/
+#if defined(__GNUC__)
+#define TRACKED_NEW __attribute__((noinline))
+#else
+#define TRACKED_NEW
+#endif
+template <MemCategory C>
+struct Tracked {
+    TRACKED_NEW static void* operator new(size_t sz) {
+        memStats.allocated(C, sz);
+        return ::operator new(sz);
+    }
+    static void operator delete(void* p, size_t sz) {
+        memStats.released(C, sz);
+        ::operator delete(p, sz);
+    }
+};
+
+#endif
@@ -2,138 +2,460 @@
 #define object_hpp
 #include <iostream>
 #include <vector>
+#include <cstring>
+#include <cstdint>
+#include <sstream>
+#include <string_view>
+#include "memstats.hpp"
+#include "matrix.hpp"
 using namespace std;
 
 enum ObjectType {
-    NUMBER, STRING, BOOL, FUNCTION, VECTOR, NIL
+    NUMBER, INTEGER, STRING, BOOL, FUNCTION, VECTOR, MAP, SEQUENCE, ARRAY, SLICE, ROPE, MATRIX, NIL
 };
 
 struct Function;
+struct Object;
+class ObjectMap;
+class Sequence;
+class NumArray;
+class Slice;
+class Rope;
+
+typedef vector<Object, TrackingAllocator<Object, MEM_VECTOR>> ObjectVector;
+typedef vector<double, TrackingAllocator<double, MEM_VECTOR>> DoubleVector;
+typedef basic_string<char, char_traits<char>, TrackingAllocator<char, MEM_STRING>> TextBuffer;
+
+inline string* newString(const string& str) {
+    memStats.allocated(MEM_STRING, sizeof(string) + (str.size() > 15 ? str.size() + 1 : 0));
+    return new string(str);
+}
 
 struct Object {
     ObjectType type;
     union {
         double numval;
+        int64_t intval;
         bool boolval;
         std::string* stringval;
         Function* func;
-        vector<Object>* vec;
+        ObjectVector* vec;
+        ObjectMap* map;
+        Sequence* seq;
+        NumArray* arr;
+        Slice* slice;
+        Rope* rope;
+        Matrix* mat;
     };
     Object(double v) : type(NUMBER) { numval = v; }
+    Object(int64_t v) : type(INTEGER) { intval = v; }
     Object(bool v) : type(BOOL) { boolval = v; }
-    Object(string v) : type(STRING) { stringval = new string(v); }
+    Object(const string& v) : type(STRING) { stringval = newString(v); }
     Object(Function* fn) : type(FUNCTION), func(fn) { }
-    Object(vector<Object>* obj) : type(VECTOR), vec(obj) { }
+    Object(ObjectVector* obj) : type(VECTOR), vec(obj) { }
+    Object(ObjectMap* obj) : type(MAP), map(obj) { }
+    Object(Sequence* obj) : type(SEQUENCE), seq(obj) { }
+    Object(NumArray* obj) : type(ARRAY), arr(obj) { }
+    Object(Slice* obj) : type(SLICE), slice(obj) { }
+    Object(Rope* obj) : type(ROPE), rope(obj) { }
+    Object(Matrix* obj) : type(MATRIX), mat(obj) { }
     Object() : type(NIL), numval(0.0) { }
-    Object(const Object& ob) { 
-        type = ob.type; 
-        switch (type) {
-            case NUMBER: numval = ob.numval; break;
-            case BOOL: boolval = ob.boolval; break;
-            case STRING: stringval = ob.stringval; break;
-            case FUNCTION: func = ob.func; break;
-            case VECTOR: vec = ob.vec; break;
-            default: break;
+    //every payload is a scalar or a shared pointer, so copies and moves are plain bit copies
+    Object(const Object& ob) = default;
+    Object(Object&& ob) noexcept = default;
+    ~Object() = default;
+    Object& operator=(const Object& ob) = default;
+    Object& operator=(Object&& ob) noexcept = default;
+};
+
+//Numbers stored unboxed & back to back, either in a heap buffer or in a file mapped straight into memory.
+//Files are mapped private, so writing an element copies just that page and never touches the file.
+class NumArray : public Tracked<MEM_VECTOR> {
+    private:
+        DoubleVector owned;
+        double* data;
+        size_t count;
+    public:
+        NumArray(double* mapped, size_t n) : data(mapped), count(n) { }
+        NumArray(DoubleVector&& values) : owned(std::move(values)), data(owned.data()), count(owned.size()) { }
+        size_t size() const { return count; }
+        double& operator[](size_t i) { return data[i]; }
+        double* begin() { return data; }
+        double* end() { return data + count; }
+};
+
+/*
+    A window onto a vector, array or matrix row: elements offset, offset+stride, offset+2*stride.. of its parent.
+    Taking one copies nothing, so halving a vector costs the same however long it is.
+    Until it is first stored into, a slice reads straight from its parent and so sees stores
+    made to the parent; that first store copies its elements out into a vector of its own,
+    so the parent is never changed through a slice.
+*/
+class Slice : public Tracked<MEM_VECTOR> {
+    private:
+        Object parent;
+        size_t offset;
+        size_t length;
+        size_t stride;
+        ObjectVector* own;
+    public:
+        Slice(const Object& of, size_t from, size_t count, size_t step)
+            : parent(of), offset(from), length(count), stride(step), own(nullptr) { }
+        size_t size() const { return length; }
+        Object get(size_t i) const {
+            if (own != nullptr)
+                return (*own)[i];
+            size_t at = offset + i * stride;
+            switch (parent.type) {
+                case ARRAY:  return Object((*parent.arr)[at]);
+                case MATRIX: return Object(parent.mat->begin()[at]);
+                default: break;
+            }
+            return (*parent.vec)[at];
         }
-    }
-    ~Object() { }
-    Object& operator=(const Object& ob) {
-        if (this != &ob) {
-            type = ob.type; 
-            switch (type) {
-                case NUMBER: numval = ob.numval; break;
-                case BOOL: boolval = ob.boolval; break;
-                case STRING: stringval = ob.stringval; break;
-                case FUNCTION: func = ob.func; break;
-                case VECTOR: vec = ob.vec; break;
+        void set(size_t i, const Object& value) {
+            if (own == nullptr) {
+                ObjectVector* copy = new ObjectVector();
+                copy->reserve(length);
+                for (size_t k = 0; k < length; k++)
+                    copy->push_back(get(k));
+                own = copy;
+            }
+            (*own)[i] = value;
+        }
+        //slices of slices index the same parent directly, rather than stacking up windows
+        Slice* subslice(size_t from, size_t count, size_t step) const {
+            if (own != nullptr)
+                return new Slice(Object(own), from, count, step);
+            return new Slice(parent, offset + from * stride, count, stride * step);
+        }
+};
+
+/*
+    What concatenating strings produces: the first 'length' characters of a buffer that only
+    ever grows. Appending to the rope that reaches the end of its buffer extends the buffer
+    in place, so building a string a piece at a time costs amortized O(1) per piece, while
+    the rope appended to still sees only its own prefix. Appending to any other rope copies
+    it into a new buffer first. The characters are always contiguous, so there is nothing
+    to flatten: printing, comparing & subscripting read the prefix where it lies.
+*/
+class Rope : public Tracked<MEM_STRING> {
+    private:
+        TextBuffer* buffer;
+        size_t length;
+        Rope(TextBuffer* buf, size_t len) : buffer(buf), length(len) { }
+    public:
+        static Rope* make(string_view head, string_view tail) {
+            TextBuffer* buf = new TextBuffer();
+            buf->reserve(2 * (head.size() + tail.size()));
+            buf->append(head.data(), head.size());
+            buf->append(tail.data(), tail.size());
+            return new Rope(buf, buf->size());
+        }
+        size_t size() const { return length; }
+        string_view view() const { return string_view(buffer->data(), length); }
+        Rope* append(string_view tail) {
+            //a rope appended to itself would be reading the buffer as it grows
+            bool aliased = tail.data() >= buffer->data() && tail.data() < buffer->data() + buffer->size();
+            if (length != buffer->size() || aliased)
+                return make(view(), tail);
+            buffer->append(tail.data(), tail.size());
+            return new Rope(buffer, buffer->size());
+        }
+};
+
+inline bool isNumber(const Object& ob) {
+    return ob.type == NUMBER || ob.type == INTEGER;
+}
+
+inline double doubleOf(const Object& ob) {
+    return ob.type == INTEGER ? (double)ob.intval : ob.numval;
+}
+
+//a number as an index or count, truncating a double
+inline int64_t integerOf(const Object& ob) {
+    return ob.type == INTEGER ? ob.intval : (int64_t)ob.numval;
+}
+
+//the integer d holds exactly, if it holds one, so 2 & 2.0 can be the same key
+inline bool exactInteger(double d, int64_t& out) {
+    if (!(d >= -0x1p63 && d < 0x1p63) || d != (double)(int64_t)d)
+        return false;
+    out = (int64_t)d;
+    return true;
+}
+
+//integer arithmetic wraps around on overflow, as the machine's does, rather than rounding to a double
+inline int64_t wrapAdd(int64_t l, int64_t r) { return (int64_t)((uint64_t)l + (uint64_t)r); }
+inline int64_t wrapSub(int64_t l, int64_t r) { return (int64_t)((uint64_t)l - (uint64_t)r); }
+inline int64_t wrapMul(int64_t l, int64_t r) { return (int64_t)((uint64_t)l * (uint64_t)r); }
+
+inline bool isText(const Object& ob) {
+    return ob.type == STRING || ob.type == ROPE;
+}
+
+inline string_view textOf(const Object& ob) {
+    return ob.type == ROPE ? ob.rope->view() : string_view(*ob.stringval);
+}
+
+//Open addressing hash table with linear probing, keyed on Object values.
+//Hashes are kept alongside each slot so probes rarely touch string payloads.
+class ObjectMap {
+    public:
+        struct Slot {
+            size_t hash;
+            Object key;
+            Object value;
+        };
+        static size_t mix(uint64_t x) {
+            x ^= x >> 33;
+            x *= 0xff51afd7ed558ccdULL;
+            x ^= x >> 33;
+            x *= 0xc4ceb9fe1a85ec53ULL;
+            x ^= x >> 33;
+            return x;
+        }
+        static size_t hashKey(const Object& key) {
+            switch (key.type) {
+                case NUMBER: {
+                    int64_t whole;
+                    if (exactInteger(key.numval, whole))
+                        return mix(whole);
+                    uint64_t bits;
+                    memcpy(&bits, &key.numval, sizeof(bits));
+                    return mix(bits);
+                }
+                case INTEGER: return mix(key.intval);
+                case STRING:
+                case ROPE:   return std::hash<string_view>()(textOf(key));
+                case BOOL:   return mix(key.boolval);
                 default: break;
             }
+            return mix((uintptr_t)key.func);
+        }
+        static bool sameKey(const Object& lhs, const Object& rhs) {
+            if (isText(lhs) || isText(rhs))
+                return isText(lhs) && isText(rhs) && textOf(lhs) == textOf(rhs);
+            if (lhs.type != rhs.type && isNumber(lhs) && isNumber(rhs)) {
+                int64_t whole;
+                const Object& real = lhs.type == NUMBER ? lhs : rhs;
+                const Object& integer = lhs.type == INTEGER ? lhs : rhs;
+                return exactInteger(real.numval, whole) && whole == integer.intval;
+            }
+            if (lhs.type != rhs.type)
+                return false;
+            switch (lhs.type) {
+                case NUMBER:  return lhs.numval == rhs.numval;
+                case INTEGER: return lhs.intval == rhs.intval;
+                case BOOL:    return lhs.boolval == rhs.boolval;
+                default: break;
+            }
+            return lhs.func == rhs.func;
+        }
+    private:
+        vector<Slot, TrackingAllocator<Slot, MEM_MAP>> slots;
+        size_t count;
+        size_t probe(const Object& key, size_t hash) const {
+            size_t mask = slots.size() - 1;
+            size_t i = hash & mask;
+            while (slots[i].key.type != NIL) {
+                if (slots[i].hash == hash && sameKey(slots[i].key, key))
+                    return i;
+                i = (i + 1) & mask;
+            }
+            return i;
+        }
+        void grow(size_t capacity) {
+            auto old = std::move(slots);
+            slots.assign(capacity, Slot{0, Object(), Object()});
+            for (auto& slot : old) {
+                if (slot.key.type != NIL)
+                    slots[probe(slot.key, slot.hash)] = slot;
+            }
+        }
+    public:
+        ObjectMap(size_t expected = 0) : count(0) {
+            size_t capacity = 8;
+            while (capacity * 3 < expected * 4)
+                capacity *= 2;
+            slots.assign(capacity, Slot{0, Object(), Object()});
+        }
+        size_t size() const { return count; }
+        const Object* find(const Object& key) const {
+            const Slot& slot = slots[probe(key, hashKey(key))];
+            return slot.key.type == NIL ? nullptr : &slot.value;
+        }
+        Object get(const Object& key) const {
+            const Object* found = find(key);
+            return found ? *found : Object();
+        }
+        void set(const Object& key, const Object& value) {
+            if (key.type == NIL)
+                return;
+            size_t hash = hashKey(key);
+            size_t i = probe(key, hash);
+            if (slots[i].key.type == NIL) {
+                if ((count + 1) * 4 > slots.size() * 3) {
+                    grow(slots.size() * 2);
+                    i = probe(key, hash);
+                }
+                slots[i].hash = hash;
+                slots[i].key = key;
+                count++;
+            }
+            slots[i].value = value;
+        }
+        template <class F> void forEach(F fn) const {
+            for (const auto& slot : slots) {
+                if (slot.key.type != NIL)
+                    fn(slot.key, slot.value);
+            }
         }
-        return *this;
-    }
 };
 
+Object concat(const Object& lhs, const Object& rhs);
+
+//a matrix combined element by element with a matrix of the same shape, or with a number on either side
+template <class Op> Object elementwise(const Object& lhs, const Object& rhs, Op op) {
+    if (lhs.type == MATRIX && rhs.type == MATRIX) {
+        if (lhs.mat->sameShape(*rhs.mat))
+            return Object(Matrix::zip(*lhs.mat, *rhs.mat, op));
+        cout<<"Can't combine a "<<lhs.mat->rows()<<"x"<<lhs.mat->cols()<<" matrix with a "
+            <<rhs.mat->rows()<<"x"<<rhs.mat->cols()<<" one."<<endl;
+    } else if (isNumber(lhs)) {
+        return Object(Matrix::scale(*rhs.mat, doubleOf(lhs), true, op));
+    } else if (isNumber(rhs)) {
+        return Object(Matrix::scale(*lhs.mat, doubleOf(rhs), false, op));
+    } else {
+        cout<<"Matrices only combine with matrices & numbers."<<endl;
+    }
+    return Object();
+}
+
+//integers stay integers, & anything else is promoted to a double
+Object add(const Object& lhs, const Object& rhs) {
+    if (lhs.type == INTEGER && rhs.type == INTEGER)
+        return Object(wrapAdd(lhs.intval, rhs.intval));
+    if (isText(lhs) || isText(rhs))
+        return concat(lhs, rhs);
+    if (lhs.type == MATRIX || rhs.type == MATRIX)
+        return elementwise(lhs, rhs, [](auto l, auto r) { return l + r; });
+    return Object(doubleOf(lhs) + doubleOf(rhs));
+}
+
+Object sub(const Object& lhs, const Object& rhs) {
+    if (lhs.type == INTEGER && rhs.type == INTEGER)
+        return Object(wrapSub(lhs.intval, rhs.intval));
+    if (lhs.type == MATRIX || rhs.type == MATRIX)
+        return elementwise(lhs, rhs, [](auto l, auto r) { return l - r; });
+    return Object(doubleOf(lhs) - doubleOf(rhs));
+}
 
-Object add(Object lhs, Object rhs) {
-    double l = lhs.numval;
-    double r = rhs.numval;
-    return Object(l+r);
+//on two matrices, '*' multiplies element by element; matmul() gives the matrix product
+Object mul(const Object& lhs, const Object& rhs) {
+    if (lhs.type == INTEGER && rhs.type == INTEGER)
+        return Object(wrapMul(lhs.intval, rhs.intval));
+    if (lhs.type == MATRIX || rhs.type == MATRIX)
+        return elementwise(lhs, rhs, [](auto l, auto r) { return l * r; });
+    return Object(doubleOf(lhs) * doubleOf(rhs));
 }
 
-Object sub(Object lhs, Object rhs) {
-    double l = lhs.numval;
-    double r = rhs.numval;
-    return Object(l-r);
+//'/' always divides exactly, so 7 / 2 is 3.5 even on integers
+Object div(const Object& lhs, const Object& rhs) {
+    if (lhs.type == MATRIX || rhs.type == MATRIX)
+        return elementwise(lhs, rhs, [](auto l, auto r) { return l / r; });
+    return Object(doubleOf(lhs) / doubleOf(rhs));
 }
 
-Object mul(Object lhs, Object rhs) {
-    double l = lhs.numval;
-    double r = rhs.numval;
-    return Object(l*r);
+//-ob, for anything but a number or matrix negating its number slot as it always has
+inline Object negative(Object ob) {
+    if (ob.type == INTEGER) ob.intval = wrapSub(0, ob.intval);
+    else if (ob.type == MATRIX) return mul(ob, Object(-1.0));
+    else ob.numval = -ob.numval;
+    return ob;
 }
 
-Object div(Object lhs, Object rhs) {
-    double l = lhs.numval;
-    double r = rhs.numval;
-    return Object(l/r);
+//two integers are compared as integers, so those past 2^53 still compare exactly
+template <class Cmp> Object compareNumbers(const Object& lhs, const Object& rhs, Cmp cmp) {
+    if (lhs.type == INTEGER && rhs.type == INTEGER)
+        return Object(cmp(lhs.intval, rhs.intval));
+    return Object(cmp(doubleOf(lhs), doubleOf(rhs)));
 }
 
-Object eq(Object lhs, Object rhs) {
+Object eq(const Object& lhs, const Object& rhs) {
     switch (lhs.type) {
-        case NUMBER: return Object(lhs.numval == rhs.numval);
-        case STRING: return Object(*lhs.stringval == *rhs.stringval);
+        case NUMBER:
+        case INTEGER: return compareNumbers(lhs, rhs, [](auto l, auto r) { return l == r; });
+        case STRING:
+        case ROPE:   return Object(isText(rhs) && textOf(lhs) == textOf(rhs));
         case BOOL:   return Object(lhs.boolval == rhs.boolval);
         case NIL:   return Object(lhs.type == rhs.type);
+        default: break;
     }
     return Object(false);
 }
 
-Object neq(Object lhs, Object rhs) {
+Object neq(const Object& lhs, const Object& rhs) {
     switch (lhs.type) {
-        case NUMBER: return Object(lhs.numval != rhs.numval);
-        case STRING: return Object(*lhs.stringval != *rhs.stringval);
+        case NUMBER:
+        case INTEGER: return compareNumbers(lhs, rhs, [](auto l, auto r) { return l != r; });
+        case STRING:
+        case ROPE:   return Object(!isText(rhs) || textOf(lhs) != textOf(rhs));
         case BOOL:   return Object(lhs.boolval != rhs.boolval);
         case NIL:   return Object(lhs.type != rhs.type);
+        default: break;
     }
     return Object(false);
 }
 
-Object lt(Object lhs, Object rhs) {
+Object lt(const Object& lhs, const Object& rhs) {
     switch (lhs.type) {
-        case NUMBER: return Object(lhs.numval < rhs.numval);
-        case STRING: return Object(*lhs.stringval < *rhs.stringval);
+        case NUMBER:
+        case INTEGER: return compareNumbers(lhs, rhs, [](auto l, auto r) { return l < r; });
+        case STRING:
+        case ROPE:   return Object(isText(rhs) && textOf(lhs) < textOf(rhs));
         case BOOL:   return Object(lhs.boolval < rhs.boolval);
         case NIL:   return Object(lhs.type < rhs.type);
+        default: break;
     }
     return Object(false);
 }
 
-Object gt(Object lhs, Object rhs) {
+Object gt(const Object& lhs, const Object& rhs) {
     switch (lhs.type) {
-        case NUMBER: return Object(lhs.numval > rhs.numval);
-        case STRING: return Object(*lhs.stringval > *rhs.stringval);
+        case NUMBER:
+        case INTEGER: return compareNumbers(lhs, rhs, [](auto l, auto r) { return l > r; });
+        case STRING:
+        case ROPE:   return Object(isText(rhs) && textOf(lhs) > textOf(rhs));
         case BOOL:   return Object(lhs.boolval > rhs.boolval);
         case NIL:   return Object(lhs.type > rhs.type);
+        default: break;
     }
     return Object(false);
 }
 
-Object lte(Object lhs, Object rhs) {
+Object lte(const Object& lhs, const Object& rhs) {
     switch (lhs.type) {
-        case NUMBER: return Object(lhs.numval <= rhs.numval);
-        case STRING: return Object(*lhs.stringval <= *rhs.stringval);
+        case NUMBER:
+        case INTEGER: return compareNumbers(lhs, rhs, [](auto l, auto r) { return l <= r; });
+        case STRING:
+        case ROPE:   return Object(isText(rhs) && textOf(lhs) <= textOf(rhs));
         case BOOL:   return Object(lhs.boolval <= rhs.boolval);
         case NIL:   return Object(lhs.type <= rhs.type);
+        default: break;
     }
     return Object(false);
 }
 
-Object gte(Object lhs, Object rhs) {
+Object gte(const Object& lhs, const Object& rhs) {
     switch (lhs.type) {
-        case NUMBER: return Object(lhs.numval >= rhs.numval);
-        case STRING: return Object(*lhs.stringval >= *rhs.stringval);
+        case NUMBER:
+        case INTEGER: return compareNumbers(lhs, rhs, [](auto l, auto r) { return l >= r; });
+        case STRING:
+        case ROPE:   return Object(isText(rhs) && textOf(lhs) >= textOf(rhs));
         case BOOL:   return Object(lhs.boolval >= rhs.boolval);
         case NIL:   return Object(lhs.type >= rhs.type);
+        default: break;
     }
     return Object(false);
 }
@@ -141,24 +463,189 @@ Object gte(Object lhs, Object rhs) {
 std::ostream& operator<<(ostream& os, const Object& ob) {
     switch (ob.type) {
         case NUMBER: os<<ob.numval; break;
+        case INTEGER: os<<ob.intval; break;
         case BOOL: os<<(ob.boolval ? "true":"false"); break;
         case STRING: os<<*ob.stringval; break;
+        case ROPE: os<<ob.rope->view(); break;
         case FUNCTION: os<<"(func)"; break;
+        case SEQUENCE: os<<"(sequence)"; break;
         case NIL: os<<"nil"; break;
         case VECTOR: {
             os<<"vector, size="<<ob.vec->size()<<", { ";
-            for (auto m : *ob.vec) {
+            for (const auto& m : *ob.vec) {
                 os<<m<<" ";
             } 
-            cout<<"}";
+            os<<"}";
+        } break;
+        case SLICE: {
+            os<<"slice, size="<<ob.slice->size()<<", { ";
+            for (size_t i = 0; i < ob.slice->size(); i++) {
+                os<<ob.slice->get(i)<<" ";
+            }
+            os<<"}";
+        } break;
+        case ARRAY: {
+            os<<"array, size="<<ob.arr->size()<<", { ";
+            for (double d : *ob.arr) {
+                os<<d<<" ";
+            }
+            os<<"}";
+        } break;
+        case MATRIX: {
+            os<<"matrix, size="<<ob.mat->rows()<<"x"<<ob.mat->cols()<<", { ";
+            for (size_t i = 0; i < ob.mat->rows(); i++) {
+                os<<"{ ";
+                for (size_t j = 0; j < ob.mat->cols(); j++)
+                    os<<ob.mat->at(i, j)<<" ";
+                os<<"} ";
+            }
+            os<<"}";
+        } break;
+        case MAP: {
+            os<<"map, size="<<ob.map->size()<<", { ";
+            ob.map->forEach([&](const Object& k, const Object& v) {
+                os<<k<<": "<<v<<" ";
+            });
+            os<<"}";
         } break;
         default: break;
     }
     return os;
 }
 
+//text joined to anything else, which is formatted just as println would print it
+Object concat(const Object& lhs, const Object& rhs) {
+    string formatted;
+    string_view tail;
+    if (isText(rhs)) {
+        tail = textOf(rhs);
+    } else {
+        ostringstream ss;
+        ss<<rhs;
+        formatted = ss.str();
+        tail = formatted;
+    }
+    if (lhs.type == ROPE)
+        return Object(lhs.rope->append(tail));
+    if (lhs.type == STRING)
+        return Object(Rope::make(*lhs.stringval, tail));
+    ostringstream ss;
+    ss<<lhs;
+    return Object(Rope::make(ss.str(), tail));
+}
+
 Object operator+(const Object& lhs, const Object& rhs) {
     return add(lhs, rhs);
 }
 
+inline bool inRange(long position, size_t size) {
+    if (position >= 0 && (size_t)position < size)
+        return true;
+    cout<<"Index "<<position<<" out of range."<<endl;
+    return false;
+}
+
+//container[key], for every kind of container
+inline Object subscript(const Object& container, const Object& key) {
+    if (container.type == MAP)
+        return container.map->get(key);
+    long position = integerOf(key);
+    //a row of a matrix is a slice over its part of the buffer
+    if (container.type == MATRIX) {
+        Matrix* m = container.mat;
+        return inRange(position, m->rows()) ? Object(new Slice(container, position * m->cols(), m->cols(), 1)) : Object();
+    }
+    if (container.type == ARRAY)
+        return inRange(position, container.arr->size()) ? Object((*container.arr)[position]) : Object();
+    if (container.type == SLICE)
+        return inRange(position, container.slice->size()) ? container.slice->get(position) : Object();
+    if (isText(container)) {
+        string_view text = textOf(container);
+        return inRange(position, text.size()) ? Object(string(1, text[position])) : Object();
+    }
+    if (container.type != VECTOR) {
+        cout<<"Only vectors, arrays, slices, matrices, maps & strings can be subscripted."<<endl;
+        return Object();
+    }
+    return inRange(position, container.vec->size()) ? (*container.vec)[position] : Object();
+}
+
+//container[key] := value
+inline void storeElement(const Object& container, const Object& key, const Object& value) {
+    if (container.type == MAP) {
+        container.map->set(key, value);
+        return;
+    }
+    long position = integerOf(key);
+    if (container.type == MATRIX) {
+        cout<<"Can't store a whole row of a matrix; store its elements with m[i][j] := v."<<endl;
+    } else if (container.type == SLICE) {
+        if (inRange(position, container.slice->size()))
+            container.slice->set(position, value);
+    } else if (container.type == ARRAY) {
+        if (!inRange(position, container.arr->size())) return;
+        if (!isNumber(value))
+            cout<<"Arrays only hold numbers."<<endl;
+        else (*container.arr)[position] = doubleOf(value);
+    } else if (container.type == VECTOR) {
+        if (inRange(position, container.vec->size()))
+            (*container.vec)[position] = value;
+    } else {
+        cout<<"Only vectors, arrays, slices, matrices & maps can be stored into."<<endl;
+    }
+}
+
+//container[row][col]: an element of a matrix is read in place, without making a slice of its row
+inline Object subscript(const Object& container, const Object& row, const Object& col) {
+    if (container.type != MATRIX)
+        return subscript(subscript(container, row), col);
+    Matrix* m = container.mat;
+    long i = integerOf(row), j = integerOf(col);
+    if (!inRange(i, m->rows()) || !inRange(j, m->cols()))
+        return Object();
+    return Object(m->at(i, j));
+}
+
+//container[row][col] := value, storing straight into a matrix's buffer
+inline void storeElement(const Object& container, const Object& row, const Object& col, const Object& value) {
+    if (container.type != MATRIX) {
+        storeElement(subscript(container, row), col, value);
+        return;
+    }
+    Matrix* m = container.mat;
+    long i = integerOf(row), j = integerOf(col);
+    if (!inRange(i, m->rows()) || !inRange(j, m->cols()))
+        return;
+    if (!isNumber(value))
+        cout<<"Matrices only hold numbers."<<endl;
+    else m->at(i, j) = doubleOf(value);
+}
+
+//how many elements ob has to slice, or -1 if it can't be sliced
+inline long sliceableLength(const Object& ob) {
+    switch (ob.type) {
+        case VECTOR: return ob.vec->size();
+        case ARRAY:  return ob.arr->size();
+        case SLICE:  return ob.slice->size();
+        case STRING:
+        case ROPE:   return textOf(ob).size();
+        default: break;
+    }
+    return -1;
+}
+
+//count elements of ob, every stride'th from 'from', which must all lie within it
+inline Object sliceOf(const Object& ob, long from, size_t count, long stride) {
+    if (isText(ob)) {
+        string_view text = textOf(ob);
+        string sub;
+        for (size_t i = 0; i < count; i++)
+            sub.push_back(text[from + i * stride]);
+        return Object(sub);
+    }
+    if (ob.type == SLICE)
+        return Object(ob.slice->subslice(from, count, stride));
+    return Object(new Slice(ob, from, count, stride));
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,1005 @@
+#ifndef optimizer_hpp
+#define optimizer_hpp
+#include <iostream>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <cmath>
+#include <sstream>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <algorithm>
+#include "token.hpp"
+#include "syntaxtree.hpp"
+#include "typechecker.hpp"
+using namespace std;
+
+//Walks the whole tree, letting subclasses swap out any expression.
+//Every visit of an expression leaves that expression's replacement in result.
+class TreeRewriter : public Visitor<> {
+    protected:
+        ExpressionNode* result = nullptr;
+        virtual ExpressionNode* rewrite(ExpressionNode* expr) {
+            if (expr == nullptr)
+                return nullptr;
+            result = expr;
+            expr->accept(this);
+            return result;
+        }
+        void rewrite(StatementNode* stmt) {
+            if (stmt != nullptr)
+                stmt->accept(this);
+        }
+    public:
+        void visit(ProgramStatement* ps) override {
+            rewrite(ps->getStatement());
+        }
+        void visit(StatementList* sl) override {
+            for (auto m : sl->getStatements()) {
+                rewrite(m);
+            }
+        }
+        void visit(ParameterList* pl) override { }
+        void visit(PrintStatement* ps) override {
+            ps->setExpression(rewrite(ps->getExpression()));
+        }
+        void visit(WhileStatement* ws) override {
+            ws->setTestExpr(rewrite(ws->getTestExpr()));
+            rewrite(ws->getLoopBody());
+        }
+        void visit(ForStatement* fs) override {
+            fs->setIterable(rewrite(fs->getIterable()));
+            rewrite(fs->getLoopBody());
+        }
+        void visit(IfStatement* is) override {
+            is->setTestExpr(rewrite(is->getTest()));
+            rewrite(is->getPassCase());
+            rewrite(is->getFailCase());
+        }
+        void visit(FuncDefStatement* ds) override {
+            rewrite(ds->getBody());
+        }
+        void visit(ReturnStatement* rs) override {
+            rs->setRetVal(rewrite(rs->getRetVal()));
+        }
+        void visit(YieldStatement* ys) override {
+            ys->setValue(rewrite(ys->getValue()));
+        }
+        void visit(VarDefStatement* vd) override {
+            vd->setExpr(rewrite(vd->getExpr()));
+        }
+        void visit(ExprStatement* es) override {
+            es->setExpr(rewrite(es->getExpression()));
+        }
+        void visit(IdExpression* idexpr) override {
+            result = idexpr;
+        }
+        void visit(LiteralExpression* lit) override {
+            result = lit;
+        }
+        void visit(AssignExpression* assign) override {
+            if (assign->getLeft()->getToken().type == TK_LBRACK)
+                rewrite(assign->getLeft());
+            assign->setRight(rewrite(assign->getRight()));
+            result = assign;
+        }
+        void visit(IncrementExpression* inc) override {
+            result = inc;
+        }
+        void visit(BinaryExpression* bin) override {
+            bin->setLeft(rewrite(bin->getLeft()));
+            bin->setRight(rewrite(bin->getRight()));
+            result = bin;
+        }
+        void visit(RelOpExpression* rel) override {
+            rel->setLeft(rewrite(rel->getLeft()));
+            rel->setRight(rewrite(rel->getRight()));
+            result = rel;
+        }
+        void visit(UnaryExpression* unary) override {
+            unary->setLeft(rewrite(unary->getLeft()));
+            result = unary;
+        }
+        void visit(FunctionCall* fc) override {
+            for (auto& arg : fc->getArgs()) {
+                arg = rewrite(arg);
+            }
+            result = fc;
+        }
+        void visit(ListExpression* le) override {
+            for (auto& m : le->getExprsList()) {
+                m = rewrite(m);
+            }
+            result = le;
+        }
+        void visit(MapExpression* me) override {
+            for (auto& entry : me->getEntries()) {
+                entry.first = rewrite(entry.first);
+                entry.second = rewrite(entry.second);
+            }
+            result = me;
+        }
+        void visit(SubscriptExpression* se) override {
+            se->setName(rewrite(se->getName()));
+            se->setPosition(rewrite(se->getPosition()));
+            result = se;
+        }
+        void visit(SliceExpression* se) override {
+            se->setName(rewrite(se->getName()));
+            se->setFrom(rewrite(se->getFrom()));
+            se->setTo(rewrite(se->getTo()));
+            se->setStride(rewrite(se->getStride()));
+            result = se;
+        }
+};
+
+//Counts how many times each variable is written, without descending into function bodies
+class AssignedNames : public TreeRewriter {
+    public:
+        unordered_map<string, int> writes;
+        void visit(FuncDefStatement* ds) override {
+            writes[ds->getName()]++;
+        }
+        void visit(VarDefStatement* vd) override {
+            writes[vd->getName()]++;
+            TreeRewriter::visit(vd);
+        }
+        void visit(ForStatement* fs) override {
+            writes[fs->getVarName()]++;
+            TreeRewriter::visit(fs);
+        }
+        void visit(AssignExpression* assign) override {
+            if (assign->getLeft()->getToken().type == TK_ID)
+                writes[assign->getLeft()->getToken().lexeme]++;
+            TreeRewriter::visit(assign);
+        }
+        void visit(IncrementExpression* inc) override {
+            writes[inc->getTarget()->getId()]++;
+            result = inc;
+        }
+        bool written(const string& id) {
+            return writes.find(id) != writes.end();
+        }
+};
+
+//Every name bound anywhere in the program, counting parameters & function bodies
+class ProgramBindings : public AssignedNames {
+    public:
+        list<FuncDefStatement*> defs;
+        void visit(FuncDefStatement* ds) override {
+            writes[ds->getName()]++;
+            defs.push_back(ds);
+            if (ds->getParams() != nullptr)
+                ds->getParams()->accept(this);
+            rewrite(ds->getBody());
+        }
+        void visit(ParameterList* pl) override {
+            for (auto m : pl->getParams()) {
+                VarDefStatement* vd = dynamic_cast<VarDefStatement*>(m);
+                if (vd != nullptr) writes[vd->getName()]++;
+            }
+        }
+};
+
+inline bool isNumberLiteral(ExpressionNode* expr) {
+    return expr != nullptr && (expr->getToken().type == TK_NUMBER || expr->getToken().type == TK_INTEGER)
+        && dynamic_cast<LiteralExpression*>(expr) != nullptr;
+}
+
+inline Object literalValue(ExpressionNode* expr) {
+    Environment none;
+    return ((LiteralExpression*)expr)->eval(none);
+}
+
+//an integer, or a double with nothing after the point
+inline bool isWhole(const Object& ob) {
+    return ob.type == INTEGER || (ob.type == NUMBER && ob.numval == floor(ob.numval));
+}
+
+inline bool isVariable(ExpressionNode* expr, const string& id) {
+    return expr != nullptr && expr->getToken().type == TK_ID && expr->getToken().lexeme == id
+        && dynamic_cast<IdExpression*>(expr) != nullptr;
+}
+
+inline ExprStatement* makeAssignment(const string& id, ExpressionNode* value) {
+    AssignExpression* assign = new AssignExpression(Token(TK_ASSIGN, ":="));
+    assign->setLeft(new IdExpression(Token(TK_ID, id)));
+    assign->setRight(value);
+    ExprStatement* stmt = new ExprStatement(Token(TK_SEMI, ";"));
+    stmt->setExpr(assign);
+    return stmt;
+}
+
+inline ExprStatement* makeIncrement(const string& id, const Object& delta) {
+    IncrementExpression* inc = new IncrementExpression(Token(TK_ASSIGN, ":="));
+    inc->setTarget(new IdExpression(Token(TK_ID, id)));
+    inc->setDelta(delta);
+    ExprStatement* stmt = new ExprStatement(Token(TK_SEMI, ";"));
+    stmt->setExpr(inc);
+    return stmt;
+}
+
+//Replaces 'id * k' for a basic induction variable 'id' (stepped once per iteration
+//by a whole constant) with a derived variable that is stepped by k alongside it.
+//Only products the type checker proved are integers are reduced: stepping a double
+//accumulates rounding error that recomputing 'id * k' each time doesn't.
+class StrengthReducer : public TreeRewriter {
+    private:
+        string iv;
+        Object step;
+        int& temps;
+        //keyed on type as well as value: i * 2 & i * 2.0 are different variables
+        list<pair<Object, string>> derived;
+    public:
+        list<StatementNode*> preheader;
+        list<pair<string, Object>> updates;
+        StrengthReducer(const string& id, const Object& d, int& counter) : iv(id), step(d), temps(counter) { }
+        void visit(FuncDefStatement* ds) override { }
+        void visit(BinaryExpression* bin) override {
+            TreeRewriter::visit(bin);
+            if (bin->getToken().type != TK_MULT || !bin->isInteger())
+                return;
+            ExpressionNode* factor = nullptr;
+            ExpressionNode* var = nullptr;
+            if (isVariable(bin->getLeft(), iv) && isNumberLiteral(bin->getRight())) { var = bin->getLeft(); factor = bin->getRight(); }
+            else if (isVariable(bin->getRight(), iv) && isNumberLiteral(bin->getLeft())) { var = bin->getRight(); factor = bin->getLeft(); }
+            if (factor == nullptr || !var->isInteger())
+                return;
+            Object k = literalValue(factor);
+            if (k.type != INTEGER)
+                return;
+            auto it = find_if(derived.begin(), derived.end(), [&](auto& d) {
+                return d.first.type == k.type && eq(d.first, k).boolval;
+            });
+            if (it == derived.end()) {
+                string temp = "$iv" + to_string(temps++);
+                BinaryExpression* init = new BinaryExpression(Token(TK_MULT, "*"));
+                init->setLeft(new IdExpression(Token(TK_ID, iv)));
+                init->setRight(new LiteralExpression(factor->getToken()));
+                preheader.push_back(makeAssignment(temp, init));
+                updates.push_back(make_pair(temp, mul(step, k)));
+                it = derived.insert(derived.end(), make_pair(k, temp));
+            }
+            delete bin;
+            result = new IdExpression(Token(TK_ID, it->second));
+        }
+};
+
+//Moves pure expressions whose variables are never written inside the loop into the preheader
+class InvariantHoister : public TreeRewriter {
+    private:
+        AssignedNames& assigned;
+        int& temps;
+        bool invariant;
+        static bool worthHoisting(ExpressionNode* expr) {
+            return dynamic_cast<BinaryExpression*>(expr) != nullptr
+                || dynamic_cast<RelOpExpression*>(expr) != nullptr
+                || dynamic_cast<UnaryExpression*>(expr) != nullptr;
+        }
+        ExpressionNode* process(ExpressionNode* expr, bool& inv) {
+            invariant = true;
+            expr = TreeRewriter::rewrite(expr);
+            inv = invariant;
+            return expr;
+        }
+        ExpressionNode* hoist(ExpressionNode* expr) {
+            if (!worthHoisting(expr))
+                return expr;
+            string temp = "$inv" + to_string(temps++);
+            preheader.push_back(makeAssignment(temp, expr));
+            return new IdExpression(Token(TK_ID, temp));
+        }
+    protected:
+        ExpressionNode* rewrite(ExpressionNode* expr) override {
+            if (expr == nullptr)
+                return nullptr;
+            bool inv;
+            expr = process(expr, inv);
+            return inv ? hoist(expr) : expr;
+        }
+    public:
+        list<StatementNode*> preheader;
+        InvariantHoister(AssignedNames& names, int& counter) : assigned(names), temps(counter) { }
+        void visit(FuncDefStatement* ds) override { }
+        void visit(IdExpression* idexpr) override {
+            invariant = !assigned.written(idexpr->getId());
+            result = idexpr;
+        }
+        void visit(LiteralExpression* lit) override {
+            invariant = true;
+            result = lit;
+        }
+        template <class T> void binary(T* node) {
+            bool l, r;
+            node->setLeft(process(node->getLeft(), l));
+            node->setRight(process(node->getRight(), r));
+            if (!(l && r)) {
+                if (l) node->setLeft(hoist(node->getLeft()));
+                if (r) node->setRight(hoist(node->getRight()));
+            }
+            invariant = l && r;
+            result = node;
+        }
+        void visit(BinaryExpression* bin) override { binary(bin); }
+        void visit(RelOpExpression* rel) override { binary(rel); }
+        void visit(UnaryExpression* unary) override {
+            bool inv;
+            unary->setLeft(process(unary->getLeft(), inv));
+            invariant = inv;
+            result = unary;
+        }
+        void visit(AssignExpression* assign) override { TreeRewriter::visit(assign); invariant = false; }
+        void visit(IncrementExpression* inc) override { result = inc; invariant = false; }
+        void visit(FunctionCall* fc) override { TreeRewriter::visit(fc); invariant = false; }
+        void visit(ListExpression* le) override { TreeRewriter::visit(le); invariant = false; }
+        void visit(MapExpression* me) override { TreeRewriter::visit(me); invariant = false; }
+        void visit(SubscriptExpression* se) override { TreeRewriter::visit(se); invariant = false; }
+        void visit(SliceExpression* se) override { TreeRewriter::visit(se); invariant = false; }
+};
+
+/*
+    Rewrites while loops before they are run:
+      - 'i := i + c' becomes a single IncrementExpression
+      - 'i * k' on an induction variable becomes a derived induction variable
+      - loop invariant pure expressions are computed once, ahead of the loop
+    Loop temporaries are named with a '$', which can't appear in a script identifier.
+*/
+class LoopOptimizer : public TreeRewriter {
+    private:
+        int temps = 0;
+        //finds 'i := i + c' at the top level of a loop body, with i written nowhere else
+        StatementNode* inductionStep(StatementList* body, AssignedNames& names) {
+            for (auto stmt : body->getStatements()) {
+                ExprStatement* es = dynamic_cast<ExprStatement*>(stmt);
+                if (es == nullptr) continue;
+                IncrementExpression* inc = dynamic_cast<IncrementExpression*>(es->getExpression());
+                if (inc != nullptr && names.writes[inc->getTarget()->getId()] == 1 && isWhole(inc->getDelta()))
+                    return stmt;
+            }
+            return nullptr;
+        }
+        void reduceStrength(WhileStatement* ws, list<StatementNode*>& out) {
+            AssignedNames names;
+            ws->accept(&names);
+            StatementNode* step = inductionStep(ws->getLoopBody(), names);
+            if (step == nullptr)
+                return;
+            IncrementExpression* inc = (IncrementExpression*)((ExprStatement*)step)->getExpression();
+            StrengthReducer reducer(inc->getTarget()->getId(), inc->getDelta(), temps);
+            ws->accept(&reducer);
+            out.splice(out.end(), reducer.preheader);
+            auto& stmts = ws->getLoopBody()->getStatements();
+            auto pos = stmts.begin();
+            while (*pos != step) pos++;
+            pos++;
+            for (auto& update : reducer.updates) {
+                stmts.insert(pos, makeIncrement(update.first, update.second));
+            }
+        }
+        void hoistInvariants(WhileStatement* ws, list<StatementNode*>& out) {
+            AssignedNames names;
+            ws->accept(&names);
+            InvariantHoister hoister(names, temps);
+            ws->accept(&hoister);
+            out.splice(out.end(), hoister.preheader);
+        }
+    public:
+        void visit(StatementList* sl) override {
+            list<StatementNode*> out;
+            for (auto m : sl->getStatements()) {
+                rewrite(m);
+                WhileStatement* ws = dynamic_cast<WhileStatement*>(m);
+                if (ws != nullptr) {
+                    reduceStrength(ws, out);
+                    hoistInvariants(ws, out);
+                }
+                out.push_back(m);
+            }
+            sl->getStatements() = std::move(out);
+        }
+        void visit(AssignExpression* assign) override {
+            TreeRewriter::visit(assign);
+            ExpressionNode* left = assign->getLeft();
+            BinaryExpression* bin = dynamic_cast<BinaryExpression*>(assign->getRight());
+            if (left->getToken().type != TK_ID || bin == nullptr)
+                return;
+            const string& id = left->getToken().lexeme;
+            TokenType op = bin->getToken().type;
+            Object delta;
+            //appending a number to text is an increment too, but prepending one isn't
+            if ((op == TK_PLUS || op == TK_MINUS) && isVariable(bin->getLeft(), id) && isNumberLiteral(bin->getRight())
+                && bin->getLeft()->getType() != ST_STRING) {
+                delta = op == TK_PLUS ? literalValue(bin->getRight()) : negative(literalValue(bin->getRight()));
+            } else if (op == TK_PLUS && isNumberLiteral(bin->getLeft()) && isVariable(bin->getRight(), id)
+                && (bin->getRight()->isNumeric() || bin->getRight()->isInteger())) {
+                delta = literalValue(bin->getLeft());
+            } else return;
+            IncrementExpression* inc = new IncrementExpression(assign->getToken());
+            inc->setTarget(new IdExpression(left->getToken()));
+            inc->setDelta(delta);
+            delete assign;
+            result = inc;
+        }
+};
+
+//Evaluates arithmetic, comparisons and negation whose operands are all literals
+class ConstantFolder : public TreeRewriter {
+    protected:
+        static LiteralExpression* literal(ExpressionNode* expr) {
+            return dynamic_cast<LiteralExpression*>(expr);
+        }
+        static Object valueOf(LiteralExpression* lit) {
+            Environment none;
+            return lit->eval(none);
+        }
+        static LiteralExpression* makeLiteral(const Token& tk, const Object& value) {
+            switch (value.type) {
+                case NUMBER: {
+                    ostringstream ss;
+                    ss<<value.numval;
+                    return new LiteralExpression(Token(TK_NUMBER, ss.str()), value);
+                }
+                case INTEGER:
+                    return new LiteralExpression(Token(TK_INTEGER, to_string(value.intval)), value);
+                case BOOL:
+                    if (value.boolval) return new LiteralExpression(Token(TK_TRUE, "true"), value);
+                    return new LiteralExpression(Token(TK_FALSE, "false"), value);
+                default: break;
+            }
+            return new LiteralExpression(tk, value);
+        }
+    public:
+        using TreeRewriter::visit;
+        void visit(BinaryExpression* bin) override {
+            TreeRewriter::visit(bin);
+            LiteralExpression* l = literal(bin->getLeft());
+            LiteralExpression* r = literal(bin->getRight());
+            if (!isNumberLiteral(l) || !isNumberLiteral(r))
+                return;
+            Object lhs = valueOf(l), rhs = valueOf(r);
+            switch (bin->getToken().type) {
+                case TK_PLUS:  result = makeLiteral(bin->getToken(), add(lhs, rhs)); break;
+                case TK_MINUS: result = makeLiteral(bin->getToken(), sub(lhs, rhs)); break;
+                case TK_MULT:  result = makeLiteral(bin->getToken(), mul(lhs, rhs)); break;
+                case TK_DIV:   result = makeLiteral(bin->getToken(), div(lhs, rhs)); break;
+                default: return;
+            }
+            delete bin;
+        }
+        void visit(RelOpExpression* rel) override {
+            TreeRewriter::visit(rel);
+            LiteralExpression* l = literal(rel->getLeft());
+            LiteralExpression* r = literal(rel->getRight());
+            if (l == nullptr || r == nullptr)
+                return;
+            Object lhs = valueOf(l), rhs = valueOf(r);
+            if ((lhs.type != rhs.type && !(isNumber(lhs) && isNumber(rhs))) || lhs.type == NIL)
+                return;
+            switch (rel->getToken().type) {
+                case TK_EQU: result = makeLiteral(rel->getToken(), eq(lhs, rhs)); break;
+                case TK_NEQ: result = makeLiteral(rel->getToken(), neq(lhs, rhs)); break;
+                case TK_LT:  result = makeLiteral(rel->getToken(), lt(lhs, rhs)); break;
+                case TK_GT:  result = makeLiteral(rel->getToken(), gt(lhs, rhs)); break;
+                case TK_LTE: result = makeLiteral(rel->getToken(), lte(lhs, rhs)); break;
+                case TK_GTE: result = makeLiteral(rel->getToken(), gte(lhs, rhs)); break;
+                default: return;
+            }
+            delete rel;
+        }
+        void visit(UnaryExpression* unary) override {
+            TreeRewriter::visit(unary);
+            LiteralExpression* l = literal(unary->getLeft());
+            if (!isNumberLiteral(l))
+                return;
+            result = makeLiteral(unary->getToken(), negative(valueOf(l)));
+            delete unary;
+        }
+};
+
+/*
+    Replaces reads of variables known to hold a literal with that literal, folding as it goes.
+    Knowledge flows forward through a statement list and is dropped for anything a
+    loop or branch might write. Function bodies start from nothing, since a
+    function may run long after the globals it reads were last assigned, & so does
+    each program, since the globals may have been rebound between them.
+*/
+class ConstantPropagator : public ConstantFolder {
+    private:
+        unordered_map<string, pair<Token, Object>> known;
+        void forget(AssignedNames& names) {
+            for (auto& w : names.writes)
+                known.erase(w.first);
+        }
+    public:
+        void visit(ProgramStatement* ps) override {
+            known.clear();
+            ConstantFolder::visit(ps);
+        }
+        void visit(IdExpression* idexpr) override {
+            result = idexpr;
+            auto it = known.find(idexpr->getId());
+            if (it == known.end())
+                return;
+            result = new LiteralExpression(it->second.first, it->second.second);
+            delete idexpr;
+        }
+        void visit(AssignExpression* assign) override {
+            ConstantFolder::visit(assign);
+            if (assign->getLeft()->getToken().type != TK_ID)
+                return;
+            const string& id = assign->getLeft()->getToken().lexeme;
+            LiteralExpression* value = literal(assign->getRight());
+            if (value != nullptr) known[id] = make_pair(value->getToken(), valueOf(value));
+            else known.erase(id);
+        }
+        void visit(IncrementExpression* inc) override {
+            known.erase(inc->getTarget()->getId());
+            result = inc;
+        }
+        void visit(VarDefStatement* vd) override {
+            known.erase(vd->getName());
+            ConstantFolder::visit(vd);
+        }
+        void visit(FuncDefStatement* ds) override {
+            known.erase(ds->getName());
+            auto outer = std::move(known);
+            known.clear();
+            ConstantFolder::visit(ds);
+            known = std::move(outer);
+        }
+        void visit(WhileStatement* ws) override {
+            AssignedNames names;
+            ws->accept(&names);
+            forget(names);
+            ConstantFolder::visit(ws);
+            forget(names);
+        }
+        void visit(ForStatement* fs) override {
+            AssignedNames names;
+            fs->accept(&names);
+            forget(names);
+            ConstantFolder::visit(fs);
+            forget(names);
+        }
+        void visit(IfStatement* is) override {
+            AssignedNames names;
+            is->accept(&names);
+            is->setTestExpr(rewrite(is->getTest()));
+            auto before = known;
+            rewrite(is->getPassCase());
+            known = before;
+            rewrite(is->getFailCase());
+            known = std::move(before);
+            forget(names);
+        }
+};
+
+//Drops branches whose test is a boolean literal, loops that can never run,
+//and statements following a return in the same block
+class DeadBranchEliminator : public TreeRewriter {
+    private:
+        static int truth(ExpressionNode* expr) {
+            if (dynamic_cast<LiteralExpression*>(expr) == nullptr) return -1;
+            if (expr->getToken().type == TK_TRUE) return 1;
+            if (expr->getToken().type == TK_FALSE) return 0;
+            return -1;
+        }
+    public:
+        void visit(StatementList* sl) override {
+            list<StatementNode*> out;
+            auto& stmts = sl->getStatements();
+            while (!stmts.empty()) {
+                StatementNode* stmt = stmts.front();
+                stmts.pop_front();
+                rewrite(stmt);
+                IfStatement* is = dynamic_cast<IfStatement*>(stmt);
+                WhileStatement* ws = dynamic_cast<WhileStatement*>(stmt);
+                if (is != nullptr && truth(is->getTest()) != -1) {
+                    StatementList* taken = truth(is->getTest()) ? is->getPassCase() : is->getFailCase();
+                    if (taken != nullptr)
+                        out.splice(out.end(), taken->getStatements());
+                    delete is;
+                } else if (ws != nullptr && truth(ws->getTestExpr()) == 0) {
+                    delete ws;
+                } else {
+                    out.push_back(stmt);
+                }
+                if (!out.empty() && dynamic_cast<ReturnStatement*>(out.back()) != nullptr) {
+                    for (auto dead : stmts) delete dead;
+                    stmts.clear();
+                }
+            }
+            stmts = std::move(out);
+        }
+};
+
+//Copies a pure expression, replacing parameters with the argument expressions bound to them.
+//Leaves ok false if it meets anything it can't copy.
+class ExpressionCloner : public TreeRewriter {
+    private:
+        unordered_map<string, ExpressionNode*>& bindings;
+        ExpressionNode* copy(ExpressionNode* expr) {
+            result = nullptr;
+            if (ok && expr != nullptr) expr->accept(this);
+            return result;
+        }
+    public:
+        bool ok = true;
+        ExpressionCloner(unordered_map<string, ExpressionNode*>& b) : bindings(b) { }
+        ExpressionNode* clone(ExpressionNode* expr) {
+            ExpressionNode* node = copy(expr);
+            if (!ok) {
+                delete node;
+                return nullptr;
+            }
+            return node;
+        }
+        void visit(IdExpression* idexpr) override {
+            auto it = bindings.find(idexpr->getId());
+            if (it == bindings.end()) {
+                result = new IdExpression(idexpr->getToken());
+                return;
+            }
+            unordered_map<string, ExpressionNode*> none;
+            ExpressionCloner argument(none);
+            result = argument.clone(it->second);
+            ok = ok && result != nullptr;
+        }
+        void visit(LiteralExpression* lit) override {
+            Environment none;
+            result = new LiteralExpression(lit->getToken(), lit->eval(none));
+        }
+        void visit(BinaryExpression* bin) override {
+            BinaryExpression* node = new BinaryExpression(bin->getToken());
+            node->setLeft(copy(bin->getLeft()));
+            node->setRight(copy(bin->getRight()));
+            result = node;
+        }
+        void visit(RelOpExpression* rel) override {
+            RelOpExpression* node = new RelOpExpression(rel->getToken());
+            node->setLeft(copy(rel->getLeft()));
+            node->setRight(copy(rel->getRight()));
+            result = node;
+        }
+        void visit(UnaryExpression* unary) override {
+            UnaryExpression* node = new UnaryExpression(unary->getToken());
+            node->setLeft(copy(unary->getLeft()));
+            result = node;
+        }
+        void visit(SubscriptExpression* se) override {
+            SubscriptExpression* node = new SubscriptExpression(se->getToken());
+            ExpressionNode* name = copy(se->getName());
+            if (name == nullptr) ok = false;
+            node->setName(name);
+            node->setPosition(copy(se->getPosition()));
+            result = node;
+        }
+        void visit(AssignExpression* assign) override { ok = false; }
+        void visit(IncrementExpression* inc) override { ok = false; }
+        void visit(FunctionCall* fc) override { ok = false; }
+        void visit(ListExpression* le) override { ok = false; }
+        void visit(MapExpression* me) override { ok = false; }
+        void visit(SliceExpression* se) override { ok = false; }
+};
+
+/*
+    Replaces calls to small functions of the form 'def f(params) { return <expr>; }'
+    with <expr>, substituting the call's arguments for the parameters.
+    Only functions defined once at the top level and never otherwise assigned are
+    considered, and only when their body is pure & calls nothing. Any other name the body
+    reads is a global, so a call is only inlined where no enclosing function binds one of
+    those names, as the copy would read the local instead.
+    Arguments must be pure too, and complex ones are only accepted if used at most once,
+    so nothing is evaluated more often than before.
+*/
+class FunctionInliner : public TreeRewriter {
+    private:
+        struct Candidate {
+            vector<string> params;
+            unordered_set<string> globals;
+            ReturnStatement* body;
+        };
+        unordered_map<string, Candidate> candidates;
+        //how many of the functions enclosing the current point bind each name
+        unordered_map<string, int> shadowed;
+        int budget;
+        //functions defined outside any other
+        class TopLevelDefs : public AssignedNames {
+            public:
+                unordered_set<FuncDefStatement*> defs;
+                void visit(FuncDefStatement* ds) override {
+                    defs.insert(ds);
+                    AssignedNames::visit(ds);
+                }
+        };
+        //node count of a pure expression, or -1 if it contains anything impure
+        class PureSize : public TreeRewriter {
+            public:
+                int size = 0;
+                bool pure = true;
+                unordered_map<string, int> uses;
+                void visit(IdExpression* idexpr) override { size++; uses[idexpr->getId()]++; result = idexpr; }
+                void visit(LiteralExpression* lit) override { size++; result = lit; }
+                void visit(BinaryExpression* bin) override { size++; TreeRewriter::visit(bin); }
+                void visit(RelOpExpression* rel) override { size++; TreeRewriter::visit(rel); }
+                void visit(UnaryExpression* unary) override { size++; TreeRewriter::visit(unary); }
+                void visit(SubscriptExpression* se) override {
+                    size++;
+                    if (se->getName() == nullptr) pure = false;
+                    TreeRewriter::visit(se);
+                }
+                void visit(AssignExpression* assign) override { pure = false; result = assign; }
+                void visit(IncrementExpression* inc) override { pure = false; result = inc; }
+                void visit(FunctionCall* fc) override { pure = false; result = fc; }
+                void visit(ListExpression* le) override { pure = false; result = le; }
+                void visit(MapExpression* me) override { pure = false; result = me; }
+                void visit(SliceExpression* se) override { pure = false; result = se; }
+                int measure(ExpressionNode* expr) {
+                    rewrite(expr);
+                    return pure ? size : -1;
+                }
+        };
+        void collect(ProgramStatement* ps) {
+            ProgramBindings names;
+            ps->accept(&names);
+            TopLevelDefs top;
+            ps->accept(&top);
+            for (auto ds : names.defs) {
+                if (names.writes[ds->getName()] != 1 || ds->getBody() == nullptr || !top.defs.count(ds))
+                    continue;
+                auto& stmts = ds->getBody()->getStatements();
+                ReturnStatement* rs = stmts.size() == 1 ? dynamic_cast<ReturnStatement*>(stmts.front()) : nullptr;
+                if (rs == nullptr || rs->getRetVal() == nullptr)
+                    continue;
+                PureSize body;
+                int size = body.measure(rs->getRetVal());
+                if (size < 0 || size > budget)
+                    continue;
+                Candidate c;
+                c.body = rs;
+                bool simple = true;
+                if (ds->getParams() != nullptr) {
+                    for (auto m : ds->getParams()->getParams()) {
+                        VarDefStatement* vd = dynamic_cast<VarDefStatement*>(m);
+                        if (vd == nullptr) simple = false;
+                        else c.params.push_back(vd->getName());
+                    }
+                }
+                for (auto& use : body.uses) {
+                    if (find(c.params.begin(), c.params.end(), use.first) == c.params.end())
+                        c.globals.insert(use.first);
+                }
+                if (simple)
+                    candidates.emplace(ds->getName(), c);
+            }
+        }
+    public:
+        FunctionInliner(int sizeBudget = 16) : budget(sizeBudget) { }
+        void visit(ProgramStatement* ps) override {
+            candidates.clear();
+            shadowed.clear();
+            collect(ps);
+            TreeRewriter::visit(ps);
+        }
+        void visit(FuncDefStatement* ds) override {
+            AssignedNames bound;
+            if (ds->getParams() != nullptr) {
+                for (auto m : ds->getParams()->getParams()) {
+                    VarDefStatement* vd = dynamic_cast<VarDefStatement*>(m);
+                    if (vd != nullptr) bound.writes[vd->getName()]++;
+                }
+            }
+            ds->getBody()->accept(&bound);
+            for (auto& w : bound.writes) shadowed[w.first]++;
+            TreeRewriter::visit(ds);
+            for (auto& w : bound.writes) shadowed[w.first]--;
+        }
+        void visit(FunctionCall* fc) override {
+            TreeRewriter::visit(fc);
+            if (fc->getName() == nullptr)
+                return;
+            auto it = candidates.find(fc->getName()->getId());
+            if (it == candidates.end() || it->second.params.size() != fc->getArgs().size())
+                return;
+            Candidate& c = it->second;
+            for (auto& id : c.globals) {
+                if (shadowed[id] > 0)
+                    return;
+            }
+            PureSize body;
+            body.measure(c.body->getRetVal());
+            unordered_map<string, ExpressionNode*> bindings;
+            auto arg = fc->getArgs().begin();
+            for (auto& param : c.params) {
+                PureSize argSize;
+                int size = argSize.measure(*arg);
+                if (size < 0 || (size > 1 && body.uses[param] > 1))
+                    return;
+                bindings[param] = *arg++;
+            }
+            ExpressionCloner cloner(bindings);
+            ExpressionNode* inlined = cloner.clone(c.body->getRetVal());
+            if (inlined == nullptr)
+                return;
+            for (auto m : fc->getArgs()) delete m;
+            delete fc->getName();
+            delete fc;
+            result = inlined;
+        }
+};
+
+/*
+    Marks functions whose result depends only on their arguments for memoization.
+    A body qualifies if it prints nothing, builds no vectors or maps, assigns no subscripts,
+    defines no functions, and only reads names it bound itself before the read: any other
+    name is a global or a captured variable, which can hold something else on the next call.
+    Calls are allowed to functions bound exactly once that qualify too, which is settled by
+    iterating until nothing changes. Only functions that make calls are marked, as a leaf
+    function is rarely more expensive than the table lookup that would replace it.
+*/
+class PurityAnalysis : public TreeRewriter {
+    private:
+        //scans one body, in execution order, tracking the names bound so far
+        class Scan : public TreeRewriter {
+            private:
+                unordered_set<string> locals;
+                //names bound inside a branch or loop body may never be bound at all
+                void scoped(StatementNode* stmt) {
+                    unordered_set<string> saved = locals;
+                    rewrite(stmt);
+                    locals = std::move(saved);
+                }
+            public:
+                bool pure = true;
+                unordered_set<string> callees;
+                Scan(FuncDefStatement* ds) {
+                    if (ds->getParams() != nullptr) {
+                        for (auto m : ds->getParams()->getParams()) {
+                            VarDefStatement* vd = dynamic_cast<VarDefStatement*>(m);
+                            if (vd == nullptr) pure = false;
+                            else locals.insert(vd->getName());
+                        }
+                    }
+                    rewrite(ds->getBody());
+                }
+                void visit(PrintStatement* ps) override { pure = false; }
+                void visit(YieldStatement* ys) override { pure = false; }
+                void visit(FuncDefStatement* ds) override { pure = false; }
+                void visit(WhileStatement* ws) override {
+                    rewrite(ws->getTestExpr());
+                    scoped(ws->getLoopBody());
+                }
+                void visit(ForStatement* fs) override {
+                    rewrite(fs->getIterable());
+                    unordered_set<string> saved = locals;
+                    locals.insert(fs->getVarName());
+                    rewrite(fs->getLoopBody());
+                    locals = std::move(saved);
+                }
+                void visit(IfStatement* is) override {
+                    rewrite(is->getTest());
+                    scoped(is->getPassCase());
+                    scoped(is->getFailCase());
+                }
+                void visit(VarDefStatement* vd) override {
+                    rewrite(vd->getExpr());
+                    locals.insert(vd->getName());
+                }
+                void visit(IdExpression* idexpr) override {
+                    if (locals.find(idexpr->getId()) == locals.end())
+                        pure = false;
+                    result = idexpr;
+                }
+                void visit(AssignExpression* assign) override {
+                    rewrite(assign->getRight());
+                    if (assign->getLeft()->getToken().type == TK_ID)
+                        locals.insert(assign->getLeft()->getToken().lexeme);
+                    else pure = false;
+                    result = assign;
+                }
+                void visit(IncrementExpression* inc) override {
+                    rewrite(inc->getTarget());
+                    result = inc;
+                }
+                void visit(SubscriptExpression* se) override {
+                    if (se->getName() == nullptr) pure = false;
+                    TreeRewriter::visit(se);
+                }
+                void visit(FunctionCall* fc) override {
+                    if (fc->getName() == nullptr || locals.count(fc->getName()->getId()))
+                        pure = false;
+                    else callees.insert(fc->getName()->getId());
+                    TreeRewriter::visit(fc);
+                }
+                void visit(ListExpression* le) override { pure = false; result = le; }
+                void visit(MapExpression* me) override { pure = false; result = me; }
+                void visit(SliceExpression* se) override { pure = false; result = se; }
+        };
+    public:
+        int marked = 0;
+        void visit(ProgramStatement* ps) override {
+            ProgramBindings names;
+            ps->accept(&names);
+            unordered_map<string, pair<FuncDefStatement*, unordered_set<string>>> pure;
+            for (auto ds : names.defs) {
+                if (names.writes[ds->getName()] != 1 || ds->getBody() == nullptr)
+                    continue;
+                Scan scan(ds);
+                if (scan.pure)
+                    pure.emplace(ds->getName(), make_pair(ds, std::move(scan.callees)));
+            }
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (auto it = pure.begin(); it != pure.end();) {
+                    bool ok = true;
+                    for (auto& callee : it->second.second) {
+                        if (pure.find(callee) == pure.end()) ok = false;
+                    }
+                    if (ok) {
+                        it++;
+                    } else {
+                        it = pure.erase(it);
+                        changed = true;
+                    }
+                }
+            }
+            for (auto& m : pure) {
+                if (!m.second.second.empty() && !m.second.first->isMemoized()) {
+                    m.second.first->setMemoized(true);
+                    marked++;
+                }
+            }
+        }
+};
+
+//Runs a sequence of rewriting passes over a program, keeping the time spent in each
+class PassManager {
+    private:
+        struct Pass {
+            string name;
+            unique_ptr<Visitor<>> pass;
+            double seconds;
+            int runs;
+        };
+        vector<Pass> passes;
+    public:
+        PassManager& add(string name, Visitor<>* pass) {
+            passes.push_back(Pass{std::move(name), unique_ptr<Visitor<>>(pass), 0.0, 0});
+            return *this;
+        }
+        void run(ProgramStatement* ps) {
+            for (auto& p : passes) {
+                auto start = chrono::steady_clock::now();
+                ps->accept(p.pass.get());
+                p.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                p.runs++;
+            }
+        }
+        void report(ostream& os) const {
+            os<<left<<setw(24)<<"pass"<<right<<setw(8)<<"runs"<<setw(14)<<"time (ms)"<<endl;
+            for (auto& p : passes) {
+                os<<left<<setw(24)<<p.name<<right<<setw(8)<<p.runs<<setw(14)<<fixed<<setprecision(3)<<p.seconds*1000<<endl;
+            }
+            os<<defaultfloat;
+        }
+};
+
+//Inlining & purity analysis assume they see every definition of a function, which only holds for a whole program
+inline PassManager& standardPipeline(PassManager& pm, bool wholeProgram = true) {
+    if (wholeProgram)
+        pm.add("function inlining", new FunctionInliner());
+    pm.add("constant folding", new ConstantFolder())
+             .add("constant propagation", new ConstantPropagator())
+             .add("dead branch elimination", new DeadBranchEliminator())
+             .add("loop optimization", new LoopOptimizer());
+    if (wholeProgram) {
+        pm.add("purity analysis", new PurityAnalysis());
+        //rewritten & newly created expressions are typed again, so they can take the unboxed paths
+        pm.add("type inference", new TypeChecker());
+    }
+    return pm;
+}
+
+#endif
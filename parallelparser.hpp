@@ -0,0 +1,75 @@
+#ifndef parallelparser_hpp
+#define parallelparser_hpp
+#include <iostream>
+#include <vector>
+#include <list>
+#include <thread>
+#include "lexer.hpp"
+#include "parser.hpp"
+using namespace std;
+
+/*
+    Lexes & parses a large source on several threads.
+    A single pass over the characters tracks brace depth, skipping string literals, and
+    records a cut after the first top-level ';' past each chunk's target size. A ';' can only
+    appear between statements, so every chunk is a sequence of whole statements that parses
+    on its own. The chunks' statement lists are spliced together in source order.
+*/
+class ParallelParser {
+    private:
+        int threads;
+        size_t minChunk;
+        vector<size_t> split(const string& src, size_t pieces) {
+            vector<size_t> cuts = { 0 };
+            size_t target = src.size() / pieces;
+            size_t next = target;
+            int depth = 0;
+            bool quoted = false;
+            for (size_t i = 0; i < src.size(); i++) {
+                char c = src[i];
+                if (c == '\"') quoted = !quoted;
+                else if (quoted) continue;
+                else if (c == '{') depth++;
+                else if (c == '}') depth--;
+                else if (c == ';' && depth == 0 && i + 1 >= next) {
+                    cuts.push_back(i + 1);
+                    next = i + 1 + target;
+                }
+            }
+            if (cuts.size() == 1 || cuts.back() != src.size())
+                cuts.push_back(src.size());
+            return cuts;
+        }
+    public:
+        ParallelParser(int nthreads = thread::hardware_concurrency(), size_t chunkBytes = 1 << 18)
+            : threads(nthreads < 1 ? 1 : nthreads), minChunk(chunkBytes) { }
+        ProgramStatement* parse(const string& src) {
+            size_t pieces = min((size_t)threads * 4, src.size() / minChunk + 1);
+            vector<size_t> cuts = split(src, pieces);
+            size_t chunks = cuts.size() - 1;
+            vector<ProgramStatement*> parsed(chunks, nullptr);
+            auto work = [&](size_t first) {
+                Lexer lexer;
+                Parser parser;
+                for (size_t i = first; i < chunks; i += threads) {
+                    vector<Token> tokens = lexer.lex(src.data() + cuts[i], cuts[i+1] - cuts[i]);
+                    parsed[i] = parser.parse(tokens);
+                }
+            };
+            vector<thread> pool;
+            for (size_t t = 1; t < (size_t)threads && t < chunks; t++)
+                pool.emplace_back(work, t);
+            work(0);
+            for (auto& t : pool)
+                t.join();
+            ProgramStatement* program = parsed[0];
+            auto& stmts = program->getStatement()->getStatements();
+            for (size_t i = 1; i < chunks; i++) {
+                stmts.splice(stmts.end(), parsed[i]->getStatement()->getStatements());
+                delete parsed[i];
+            }
+            return program;
+        }
+};
+
+#endif
@@ -14,23 +14,28 @@ using namespace std;
     <StatmentList> := <statement> ; {<statement>;}*
     <Statement> := [ <WhileStmt> | <IfStmt> | <PrintStmt> | <ExprStmt> ] ;
     <WhileStmt> := while ( <expression> ) { statementList }
+    <ForStmt>   := for id in <expression> { statementList }
     <IfStmt>    := if ( <expression> ) { statementList } else { statementList }
     <PrintStmt> := println <expression>
     <ExprStmt>  := <expression> ;
+    <FuncDef>   := [memo] def id ( paramList ) { statementList }
+    <YieldStmt> := yield <expression>   (makes the enclosing FuncDef a generator)
     <expression> := <relop> ':=' <relop>
     <relop>   := <term> ( == | != | < | > | <= | >= ) <term>
     <term>    := <factor> (+|-) <factor>
     <factor>  := <val> (*|/) <val>
     <unop>    := -<val>
-    <val>     := id '(' argsList ')'
-    <primary> := number | id | string | (<expr>)
+    <val>     := id '(' argsList ')' | <primary> '[' <expression> ']' | <primary> '[' [<expression>] ':' [<expression>] [':' <expression>] ']'
+    <primary> := number | id | string | (<expr>) | '[' argList ']' | '{' mapList '}'
     <argList> := <expression> { ',' <expression> }*
+    <mapList> := <expression> ':' <expression> { ',' <expression> ':' <expression> }*
  */
 
 class Parser {
     private:
         vector<Token> tokens;
         int tpos;
+        int yields;
         void advance() {
             tpos++;
         }
@@ -53,11 +58,12 @@ class Parser {
         void init(vector<Token>& tkns) {
             tokens = tkns;
             tpos = 0;
+            yields = 0;
         }
         ExpressionNode* primary() {
-            if (expect(TK_NUMBER)) {
+            if (expect(TK_NUMBER) || expect(TK_INTEGER)) {
                 LiteralExpression* lit = new LiteralExpression(current());
-                match(TK_NUMBER);
+                match(current().type);
                 return lit;
             } else if (expect(TK_ID)) {
                 IdExpression* id = new IdExpression(current());
@@ -86,16 +92,45 @@ class Parser {
                 le->setExprsList(argsList());
                 match(TK_RBRACK);
                 return le;
+            } else if (expect(TK_LCURLY)) {
+                MapExpression* me = new MapExpression(current());
+                match(TK_LCURLY);
+                if (!expect(TK_RCURLY)) {
+                    mapList(me);
+                }
+                match(TK_RCURLY);
+                return me;
             }
             return nullptr;
         }
+        //the rest of name[from:to:stride], from the first ':'
+        SliceExpression* slice(Token tk, ExpressionNode* name, ExpressionNode* from) {
+            SliceExpression* se = new SliceExpression(tk);
+            se->setName(name);
+            se->setFrom(from);
+            match(TK_COLON);
+            if (!expect(TK_COLON) && !expect(TK_RBRACK))
+                se->setTo(expression());
+            if (expect(TK_COLON)) {
+                match(TK_COLON);
+                se->setStride(expression());
+            }
+            match(TK_RBRACK);
+            return se;
+        }
         ExpressionNode* val() {
             ExpressionNode* node = primary();
             while (expect(TK_LBRACK)) {
-                SubscriptExpression* se = new SubscriptExpression(current());
+                Token tk = current();
                 match (TK_LBRACK);
-                se->setName(dynamic_cast<IdExpression*>(node));
-                se->setPosition(expression());
+                ExpressionNode* position = expect(TK_COLON) ? nullptr : expression();
+                if (expect(TK_COLON)) {
+                    node = slice(tk, node, position);
+                    continue;
+                }
+                SubscriptExpression* se = new SubscriptExpression(tk);
+                se->setName(node);
+                se->setPosition(position);
                 match(TK_RBRACK);
                 node = se;
             }
@@ -194,6 +229,18 @@ class Parser {
             match(TK_RCURLY);
             return ws;
         }
+        ForStatement* parseFor() {
+            ForStatement* fs = new ForStatement(current());
+            match(TK_FOR);
+            fs->setVarName(current().lexeme);
+            match(TK_ID);
+            match(TK_IN);
+            fs->setIterable(expression());
+            match(TK_LCURLY);
+            fs->setLoopBody(statementList());
+            match(TK_RCURLY);
+            return fs;
+        }
         FuncDefStatement* parseFuncDef() {
             FuncDefStatement* ds = new FuncDefStatement(current());
             match(TK_DEFINE);
@@ -205,7 +252,12 @@ class Parser {
             }
             match(TK_RPAREN);
             match(TK_LCURLY);
+            int outer = yields;
+            yields = 0;
             ds->setBody(statementList());
+            ds->setGenerator(yields > 0);
+            yields = outer;
+            match(TK_RCURLY);
             return ds;
         }
         StatementNode* statement() {
@@ -217,9 +269,18 @@ class Parser {
                 case TK_WHILE: {
                     return parseWhile();
                 } break;
+                case TK_FOR: {
+                    return parseFor();
+                } break;
                 case TK_DEFINE: {
                     return parseFuncDef();
                 } break;
+                case TK_MEMO: {
+                    match(TK_MEMO);
+                    FuncDefStatement* ds = parseFuncDef();
+                    ds->setMemoized(true);
+                    return ds;
+                } break;
                 case TK_VAR: {
                     VarDefStatement* vd = new VarDefStatement(current());
                     match(TK_VAR);
@@ -233,6 +294,13 @@ class Parser {
                     rs->setRetVal(expression());
                     return rs;
                 } break;
+                case TK_YIELD: {
+                    YieldStatement* ys = new YieldStatement(current());
+                    match(TK_YIELD);
+                    ys->setValue(expression());
+                    yields++;
+                    return ys;
+                } break;
                 case TK_PRINT: {
                     PrintStatement* ps = new PrintStatement(current());
                     match(current().type);
@@ -253,6 +321,8 @@ class Parser {
         }
         list<ExpressionNode*> argsList() {
             list<ExpressionNode*> args;
+            if (expect(TK_RPAREN) || expect(TK_RBRACK))
+                return args;
             args.push_back(expression());
             while (expect(TK_COMA) && !(expect(TK_RPAREN) || expect(TK_RBRACK))) {
                 match(TK_COMA);                                       
@@ -260,6 +330,14 @@ class Parser {
             }
             return args;
         }
+        void mapList(MapExpression* me) {
+            do {
+                if (expect(TK_COMA)) match(TK_COMA);
+                ExpressionNode* key = expression();
+                match(TK_COLON);
+                me->addEntry(key, expression());
+            } while (expect(TK_COMA));
+        }
         ParameterList* parameterList() {
             ParameterList* pl = new ParameterList(current());
             pl->add(statement());
@@ -0,0 +1,121 @@
+#ifndef profiler_hpp
+#define profiler_hpp
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <sys/time.h>
+using namespace std;
+
+enum ProfileMode {
+    PROF_TRACE, PROF_SAMPLE
+};
+
+/*
+    Shadow stack of script function calls, kept as paths in a call tree.
+    Tracing charges each node the wall time spent in it, minus its callees, in microseconds.
+    Sampling counts SIGPROF ticks instead; the handler only bumps a counter, which is
+    charged to whatever is on top of the stack at the next call or return.
+    Either way the result is written as folded stacks, one 'main;f;g value' line per path.
+*/
+class Profiler {
+    private:
+        typedef chrono::steady_clock Clock;
+        struct Node {
+            string name;
+            int parent;
+            size_t calls;
+            double self;
+            unordered_map<string, int> children;
+        };
+        struct Frame {
+            int node;
+            Clock::time_point start;
+            double callees;
+        };
+        vector<Node> nodes;
+        vector<Frame> stack;
+        ProfileMode mode;
+        int hz;
+        static inline atomic<int> ticks{0};
+        static void tick(int) { ticks.fetch_add(1, memory_order_relaxed); }
+        void timer(int usec) {
+            itimerval it;
+            it.it_interval.tv_sec = 0;
+            it.it_interval.tv_usec = usec;
+            it.it_value = it.it_interval;
+            setitimer(ITIMER_PROF, &it, nullptr);
+        }
+        void charge() {
+            if (mode == PROF_SAMPLE && !stack.empty())
+                nodes[stack.back().node].self += ticks.exchange(0, memory_order_relaxed);
+        }
+        int child(int parent, const string& name) {
+            auto it = nodes[parent].children.find(name);
+            if (it != nodes[parent].children.end())
+                return it->second;
+            nodes.push_back(Node{name, parent, 0, 0.0, {}});
+            nodes[parent].children.emplace(name, nodes.size() - 1);
+            return nodes.size() - 1;
+        }
+        void push(int node) {
+            nodes[node].calls++;
+            stack.push_back(Frame{node, mode == PROF_TRACE ? Clock::now() : Clock::time_point(), 0.0});
+        }
+        string path(int node) const {
+            return nodes[node].parent < 0 ? nodes[node].name : path(nodes[node].parent) + ";" + nodes[node].name;
+        }
+    public:
+        Profiler(ProfileMode m = PROF_TRACE, int rate = 1000) : mode(m), hz(rate) { }
+        void start() {
+            nodes.clear();
+            stack.clear();
+            nodes.push_back(Node{"main", -1, 0, 0.0, {}});
+            if (mode == PROF_SAMPLE) {
+                ticks = 0;
+                signal(SIGPROF, tick);
+                timer(1000000 / hz);
+            }
+            push(0);
+        }
+        void enter(const string& name) {
+            charge();
+            push(child(stack.back().node, name));
+        }
+        void leave() {
+            charge();
+            Frame frame = stack.back();
+            stack.pop_back();
+            if (mode == PROF_TRACE) {
+                double elapsed = chrono::duration<double, micro>(Clock::now() - frame.start).count();
+                nodes[frame.node].self += elapsed - frame.callees;
+                stack.back().callees += elapsed;
+            }
+        }
+        void finish() {
+            if (mode == PROF_SAMPLE) {
+                timer(0);
+                signal(SIGPROF, SIG_DFL);
+            }
+            while (stack.size() > 1)
+                leave();
+            charge();
+            if (mode == PROF_TRACE && !stack.empty()) {
+                Frame frame = stack.back();
+                double elapsed = chrono::duration<double, micro>(Clock::now() - frame.start).count();
+                nodes[frame.node].self += elapsed - frame.callees;
+            }
+            stack.clear();
+        }
+        void writeFolded(ostream& os) const {
+            for (size_t i = 0; i < nodes.size(); i++) {
+                long value = (long)(nodes[i].self + 0.5);
+                if (value > 0)
+                    os<<path(i)<<" "<<value<<"\n";
+            }
+        }
+};
+
+#endif
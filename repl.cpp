@@ -1,6 +1,16 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include "parser.hpp"
 #include "lexer.hpp"
+#include "astimage.hpp"
+#include "parallelparser.hpp"
+#include "optimizer.hpp"
+#include "typechecker.hpp"
+#include "profiler.hpp"
+#include "snapshot.hpp"
+#include "scheduler.hpp"
+#include "cppemit.hpp"
 using namespace std;
 
 class ASTBuilder {
@@ -8,11 +18,17 @@ class ASTBuilder {
         Lexer lexer;
         Parser parser;
         bool loud;
+        static const size_t parallelThreshold = 1 << 20;
     public:
         ASTBuilder(bool debug = true) {
             loud = debug;
         }
-        ProgramStatement* buildAST(string input) {
+        ProgramStatement* buildAST(const string& input) {
+            //big scripts are split at top-level statements & parsed on every core
+            if (!loud && input.size() >= parallelThreshold) {
+                ParallelParser parallel;
+                return parallel.parse(input);
+            }
             auto tokens = lexer.lex(input);
             if (loud) {
                 for (auto m : tokens) {
@@ -23,26 +39,236 @@ class ASTBuilder {
         }
 };
 
-void repl() {
+void repl(const string& restoreFrom) {
     bool looping = true;
     ASTBuilder builder;
     PrintVisitor pv;
     InterpreterVisitor iv;
+    TypeChecker checker;
+    PassManager optimizer;
+    standardPipeline(optimizer, false);
+    if (!restoreFrom.empty())
+        SnapshotLoader().restoreFile(iv, restoreFrom);
     while (looping) {
         cout<<" > ";
         string input;
         getline(cin, input);
-        if (input == "quit") {
+        if (input == "quit" || !cin) {
             looping = false;
+        } else if (input == "memstats") {
+            memStats.report(cout);
+        } else if (input == "memostats") {
+            iv.reportMemo(cout);
+        } else if (input.rfind("snapshot ", 0) == 0) {
+            SnapshotWriter().writeFile(iv.globals(), input.substr(9));
+        } else if (input.rfind("restore ", 0) == 0) {
+            SnapshotLoader().restoreFile(iv, input.substr(8));
+            //every global may now hold something else, so what was inferred about them no longer holds
+            checker = TypeChecker();
         } else {
             auto ast = builder.buildAST(input);
             pv.visit(ast);
+            checker.visit(ast);
+            if (!checker.errors.empty()) {
+                checker.report(cout);
+                continue;
+            }
+            optimizer.run(ast);
             iv.visit(ast);
         }
     }
 }
 
+string readFile(string filename) {
+    ifstream in(filename);
+    if (!in) {
+        cout<<"Couldn't open "<<filename<<endl;
+        return "";
+    }
+    stringstream ss;
+    ss<<in.rdbuf();
+    return ss.str();
+}
 
-int main() {
-    repl();
+struct Options {
+    bool image = false;
+    bool memstats = false;
+    bool optimize = true;
+    bool dumpTree = false;
+    bool passTimes = false;
+    ProfileMode profileMode = PROF_TRACE;
+    string profileTo;
+    string compileTo;
+    string emitTo;
+    string buildTo;
+    string saveTo;
+    string restoreFrom;
+    string script;
+    //with more than one script, each runs as a task & they take turns
+    vector<string> tasks;
+    vector<int> priorities;
+    int priority = 1;
+    long quantum = 10000;
+    long limit = 0;
+};
+
+void usage() {
+    cout<<"usage: repl [options] [script...]"<<endl;
+    cout<<"  with no script, starts an interactive session"<<endl;
+    cout<<"  with several, runs them all at once on one thread, each taking turns"<<endl;
+    cout<<"  -c <image>   compile the script to an AST image instead of running it"<<endl;
+    cout<<"  -e <file>    translate the script to C++ instead of running it"<<endl;
+    cout<<"  -x <file>    build the script into a native executable, or a shared object if file ends in .so"<<endl;
+    cout<<"  -i           the script is an AST image"<<endl;
+    cout<<"  -m           print heap & memo table statistics after running"<<endl;
+    cout<<"  -O0          run the tree exactly as parsed, skipping the optimizer"<<endl;
+    cout<<"  -d           print the optimized tree before running it"<<endl;
+    cout<<"  -t           print the time spent in each optimizer pass"<<endl;
+    cout<<"  -p <file>    trace every function call, writing folded stacks of microseconds to file"<<endl;
+    cout<<"  -s <file>    sample the call stack 1000 times a second, writing folded stacks to file"<<endl;
+    cout<<"  -w <file>    write a snapshot of every global to file after running"<<endl;
+    cout<<"  -r <file>    restore the globals in a snapshot before running, or before the session starts"<<endl;
+    cout<<"  -f <fuel>    loop iterations & calls each script runs per turn, times its priority"<<endl;
+    cout<<"  -P <n>       priority of the scripts after it, 1 and up"<<endl;
+    cout<<"  -l <fuel>    kill a script once it has burned this much fuel in all"<<endl;
+}
+
+bool parseOptions(int argc, char* argv[], Options& opts) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-c" && i+1 < argc) opts.compileTo = argv[++i];
+        else if (arg == "-e" && i+1 < argc) opts.emitTo = argv[++i];
+        else if (arg == "-x" && i+1 < argc) opts.buildTo = argv[++i];
+        else if (arg == "-i") opts.image = true;
+        else if (arg == "-m") opts.memstats = true;
+        else if (arg == "-O0") opts.optimize = false;
+        else if (arg == "-d") opts.dumpTree = true;
+        else if (arg == "-t") opts.passTimes = true;
+        else if ((arg == "-p" || arg == "-s") && i+1 < argc) {
+            opts.profileMode = arg == "-p" ? PROF_TRACE : PROF_SAMPLE;
+            opts.profileTo = argv[++i];
+        }
+        else if (arg == "-w" && i+1 < argc) opts.saveTo = argv[++i];
+        else if (arg == "-r" && i+1 < argc) opts.restoreFrom = argv[++i];
+        else if (arg == "-f" && i+1 < argc) opts.quantum = atol(argv[++i]);
+        else if (arg == "-P" && i+1 < argc) opts.priority = atoi(argv[++i]);
+        else if (arg == "-l" && i+1 < argc) opts.limit = atol(argv[++i]);
+        else if (arg[0] != '-') {
+            opts.tasks.push_back(arg);
+            opts.priorities.push_back(opts.priority);
+        }
+        else return false;
+    }
+    if (opts.tasks.size() == 1)
+        opts.script = opts.tasks[0];
+    bool translating = !opts.compileTo.empty() || !opts.emitTo.empty() || !opts.buildTo.empty();
+    if (opts.tasks.size() > 1)
+        return !translating && opts.saveTo.empty() && opts.profileTo.empty();
+    return opts.script.empty() ? !translating && !opts.image : true;
+}
+
+ProgramStatement* load(const string& script, Options& opts) {
+    if (opts.image) {
+        ImageLoader loader;
+        return loader.loadFile(script);
+    }
+    ASTBuilder builder(false);
+    return builder.buildAST(readFile(script));
+}
+
+//parses, checks & optimizes a script, or returns nullptr if it can't be run
+ProgramStatement* prepare(const string& script, Options& opts) {
+    ProgramStatement* ast = load(script, opts);
+    if (ast == nullptr)
+        return nullptr;
+    TypeChecker checker;
+    checker.visit(ast);
+    if (!checker.errors.empty()) {
+        checker.report(cout);
+        return nullptr;
+    }
+    if (opts.optimize) {
+        PassManager optimizer;
+        standardPipeline(optimizer).run(ast);
+        if (opts.passTimes)
+            optimizer.report(cout);
+    }
+    if (opts.dumpTree) {
+        PrintVisitor pv;
+        pv.visit(ast);
+    }
+    return ast;
+}
+
+//runs every script at once, each in its own interpreter, taking turns on this thread
+int runTasks(Options& opts) {
+    Scheduler scheduler(opts.quantum);
+    for (size_t i = 0; i < opts.tasks.size(); i++) {
+        ProgramStatement* ast = prepare(opts.tasks[i], opts);
+        if (ast == nullptr) {
+            cout<<"Skipping "<<opts.tasks[i]<<endl;
+            continue;
+        }
+        Task* task = scheduler.spawn(opts.tasks[i], ast, opts.priorities[i], opts.limit);
+        if (!opts.restoreFrom.empty() && !SnapshotLoader().restoreFile(task->interpreter(), opts.restoreFrom))
+            return 1;
+    }
+    scheduler.run();
+    if (opts.memstats) {
+        memStats.report(cout);
+        scheduler.report(cout);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        usage();
+        return 1;
+    }
+    if (opts.tasks.size() > 1)
+        return runTasks(opts);
+    if (opts.script.empty()) {
+        repl(opts.restoreFrom);
+        return 0;
+    }
+    if (!opts.compileTo.empty()) {
+        ProgramStatement* ast = load(opts.script, opts);
+        ImageWriter writer;
+        return ast != nullptr && writer.writeFile(ast, opts.compileTo) ? 0 : 1;
+    }
+    ProgramStatement* ast = prepare(opts.script, opts);
+    if (ast == nullptr)
+        return 1;
+    if (!opts.emitTo.empty())
+        return NativeCompiler().writeSource(ast, opts.emitTo) ? 0 : 1;
+    if (!opts.buildTo.empty())
+        return NativeCompiler().build(ast, opts.buildTo) ? 0 : 1;
+    InterpreterVisitor iv;
+    if (!opts.restoreFrom.empty() && !SnapshotLoader().restoreFile(iv, opts.restoreFrom))
+        return 1;
+    if (opts.profileTo.empty()) {
+        iv.visit(ast);
+    } else {
+        Profiler profiler(opts.profileMode);
+        iv.setProfiler(&profiler);
+        profiler.start();
+        iv.visit(ast);
+        profiler.finish();
+        iv.setProfiler(nullptr);
+        ofstream out(opts.profileTo);
+        if (!out) {
+            cout<<"Couldn't open "<<opts.profileTo<<endl;
+            return 1;
+        }
+        profiler.writeFolded(out);
+    }
+    if (opts.memstats) {
+        memStats.report(cout);
+        iv.reportMemo(cout);
+    }
+    if (!opts.saveTo.empty() && !SnapshotWriter().writeFile(iv.globals(), opts.saveTo))
+        return 1;
+    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,186 @@
+#ifndef scheduler_hpp
+#define scheduler_hpp
+#include <iostream>
+#include <iomanip>
+#include <deque>
+#include <vector>
+#include <ctime>
+#include <cstdint>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include "visitors.hpp"
+using namespace std;
+
+enum TaskState {
+    TASK_READY, TASK_DONE, TASK_KILLED, TASK_FAILED
+};
+
+inline string taskStateStr[] = { "ready", "done", "killed", "failed" };
+
+/*
+    One program with an interpreter of its own, run a slice at a time.
+    It runs on its own C++ stack, so running out of fuel can suspend it anywhere: deep in
+    a recursion, half way through an expression or inside a generator, & resuming it is
+    just switching back to that stack. The stack is reserved when the task first runs and
+    pages are only backed as they are touched, so a waiting task costs little more than
+    the memory its script has actually used.
+*/
+class Task : public FuelSource {
+    private:
+        friend class Scheduler;
+        string name;
+        int priority;
+        long limit;
+        ProgramStatement* program;
+        InterpreterVisitor iv;
+        TaskState state = TASK_READY;
+        ucontext_t context;
+        ucontext_t* home = nullptr;
+        char* stack = nullptr;
+        size_t stackSize = 0;
+        //accounting
+        size_t slices = 0;
+        long burned = 0;
+        double cpu = 0;
+        //makecontext only passes ints, so the task comes in two halves
+        static void entry(unsigned hi, unsigned lo) {
+            Task* task = (Task*)(((uintptr_t)hi << 32) | lo);
+            task->body();
+        }
+        void body() {
+            try {
+                iv.visit(program);
+                state = TASK_DONE;
+            } catch (exception& e) {
+                cout<<name<<" failed: "<<e.what()<<endl;
+                state = TASK_FAILED;
+            }
+            //returning switches to the scheduler through uc_link
+        }
+        bool start(size_t size) {
+            //a guard page at the bottom turns overflowing the stack into a fault, not corruption
+            void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+            if (mem == MAP_FAILED) {
+                cout<<"Couldn't reserve a stack for "<<name<<endl;
+                return false;
+            }
+            mprotect(mem, 4096, PROT_NONE);
+            stack = (char*)mem;
+            stackSize = size;
+            getcontext(&context);
+            context.uc_stack.ss_sp = stack;
+            context.uc_stack.ss_size = stackSize;
+            context.uc_link = home;
+            uintptr_t self = (uintptr_t)this;
+            makecontext(&context, (void (*)())entry, 2, (unsigned)(self >> 32), (unsigned)self);
+            return true;
+        }
+        //whatever a killed task had on its stack is abandoned, like every other object
+        void release() {
+            if (stack != nullptr)
+                munmap(stack, stackSize);
+            stack = nullptr;
+        }
+    public:
+        Task(string n, ProgramStatement* prog, int prio, long lim)
+            : name(std::move(n)), priority(prio < 1 ? 1 : prio), limit(lim), program(prog) {
+            iv.setFuelSource(this);
+        }
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        ~Task() { release(); }
+        //the task's own interpreter, to restore a snapshot into before it runs
+        InterpreterVisitor& interpreter() { return iv; }
+        const string& getName() const { return name; }
+        TaskState getState() const { return state; }
+        void outOfFuel(InterpreterVisitor&) override {
+            swapcontext(&context, home);
+        }
+};
+
+/*
+    Runs any number of tasks on the calling thread, round robin.
+    Each turn a task gets fuel in proportion to its priority, and is suspended when it
+    has burned it all, so a task stuck in an endless loop only ever holds up the others
+    for one turn. A task with a limit is killed once it has burned that much in all.
+*/
+class Scheduler {
+    private:
+        vector<Task*> tasks;
+        deque<Task*> ready;
+        ucontext_t home;
+        long quantum;
+        size_t stackSize;
+        size_t switches = 0;
+        static double cpuNow() {
+            timespec ts;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return ts.tv_sec + ts.tv_nsec / 1e9;
+        }
+        //runs task until it finishes or runs dry, returning true if it should run again
+        bool slice(Task* task) {
+            if (task->stack == nullptr && !task->start(stackSize)) {
+                task->state = TASK_FAILED;
+                return false;
+            }
+            long fuel = quantum * task->priority;
+            if (task->limit > 0 && task->limit - task->burned < fuel)
+                fuel = task->limit - task->burned;
+            task->iv.setFuel(fuel);
+            double before = cpuNow();
+            swapcontext(&home, &task->context);
+            task->cpu += cpuNow() - before;
+            task->burned += fuel - task->iv.fuelLeft();
+            task->slices++;
+            switches++;
+            if (task->state == TASK_READY && task->limit > 0 && task->burned >= task->limit) {
+                cout<<task->name<<" killed after burning "<<task->burned<<" units of fuel."<<endl;
+                task->state = TASK_KILLED;
+            }
+            if (task->state != TASK_READY) {
+                task->release();
+                return false;
+            }
+            return true;
+        }
+    public:
+        Scheduler(long fuel = 10000, size_t stack = 8 << 20) : quantum(fuel < 1 ? 1 : fuel), stackSize(stack) { }
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+        ~Scheduler() {
+            for (auto task : tasks)
+                delete task;
+        }
+        //a limit of 0 lets the task run for as long as it likes
+        Task* spawn(const string& name, ProgramStatement* program, int priority = 1, long limit = 0) {
+            Task* task = new Task(name, program, priority, limit);
+            task->home = &home;
+            tasks.push_back(task);
+            ready.push_back(task);
+            return task;
+        }
+        void run() {
+            while (!ready.empty()) {
+                Task* task = ready.front();
+                ready.pop_front();
+                if (slice(task))
+                    ready.push_back(task);
+            }
+        }
+        void report(ostream& os) {
+            os<<left<<setw(24)<<"task"<<right<<setw(6)<<"prio"<<setw(10)<<"slices"<<setw(14)<<"fuel"
+              <<setw(12)<<"cpu ms"<<setw(9)<<"state"<<endl;
+            double total = 0;
+            for (auto task : tasks) {
+                os<<left<<setw(24)<<task->name<<right<<setw(6)<<task->priority<<setw(10)<<task->slices
+                  <<setw(14)<<task->burned<<setw(12)<<fixed<<setprecision(2)<<task->cpu*1000
+                  <<setw(9)<<taskStateStr[task->state]<<defaultfloat<<endl;
+                total += task->cpu;
+            }
+            os<<tasks.size()<<" tasks, "<<switches<<" slices, "<<fixed<<setprecision(2)<<total*1000
+              <<" ms cpu"<<defaultfloat<<endl;
+        }
+};
+
+#endif
@@ -0,0 +1,462 @@
+#ifndef snapshot_hpp
+#define snapshot_hpp
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "syntaxtree.hpp"
+#include "visitors.hpp"
+#include "astimage.hpp"
+using namespace std;
+
+/*
+    Image of an interpreter's global scope & everything reachable from it, so a process can
+    pick up a warm state without re-running the script that built it.
+
+    <snapshot> := <header> <records> <globals> <ast image> <padding> <array data>
+    <header>   := magic(u32) version(u32) recordCount(u32) globalCount(u32)
+                  globalsOffset(u64) astOffset(u64) astLength(u64) dataOffset(u64)
+    <value>    := type(u8) payload(u64)      number or integer bits, bool, or a record index
+    <record>   := type(u8) <body>
+                  STRING   length(u32) bytes
+                  VECTOR   count(u32) <value>*
+                  MAP      count(u32) { <value> <value> }*
+                  FUNCTION native(u8) name(u32 length, bytes) definition(u32)
+                           upvalueCount(u32) { name(u32 length, bytes) <value> }*
+                  ARRAY    count(u64) offset(u64)
+                  MATRIX   rows(u64) cols(u64) offset(u64)
+    <globals>  := { name(u32 length, bytes) <value> }*
+
+    Records refer to each other by index, never by pointer, so restoring is one pass to
+    create an object per record, then one to fill in vectors & maps through the index table.
+    Script functions are saved as definitions in an ordinary AST image, and built-ins by
+    name, to be rebound to the restoring interpreter's own. A closure's captured values are
+    saved with it, by the names its definition captures them under. Array elements are stored raw &
+    8 byte aligned; the file is mapped privately and arrays use them in place, so even
+    gigabytes of data come back without being read. Matrix cells are stored the same way,
+    but copied out on restore, since a matrix owns its buffer. Strings built by '+' are saved flat,
+    slices as vectors of their elements, and sequences, whose state is a suspended
+    computation, as nil.
+*/
+
+const uint32_t snapshotMagic = 0x4E535056; // "VPSN"
+const uint32_t snapshotVersion = 4;
+const size_t snapshotHeaderSize = 4*sizeof(uint32_t) + 4*sizeof(uint64_t);
+
+class SnapshotWriter {
+    private:
+        vector<char> records;
+        vector<char> data;
+        unordered_map<const void*, uint32_t> ids;
+        vector<Object> pending;
+        vector<Function*> functions;
+        template <typename T> void emit(vector<char>& out, T value) {
+            const char* raw = reinterpret_cast<const char*>(&value);
+            out.insert(out.end(), raw, raw + sizeof(T));
+        }
+        void text(vector<char>& out, string_view str) {
+            emit<uint32_t>(out, str.size());
+            out.insert(out.end(), str.begin(), str.end());
+        }
+        //the record index of a heap object, queueing it to be written if it's new
+        uint32_t id(const Object& ob) {
+            const void* key = ob.func;
+            auto it = ids.find(key);
+            if (it != ids.end())
+                return it->second;
+            uint32_t idx = pending.size();
+            ids.emplace(key, idx);
+            pending.push_back(ob);
+            return idx;
+        }
+        void value(vector<char>& out, const Object& ob) {
+            uint64_t payload = 0;
+            ObjectType type = ob.type;
+            switch (ob.type) {
+                case NUMBER: memcpy(&payload, &ob.numval, sizeof(double)); break;
+                case INTEGER: payload = ob.intval; break;
+                case BOOL:   payload = ob.boolval; break;
+                case ROPE:   type = STRING; payload = id(ob); break;
+                case SLICE:  type = VECTOR; payload = id(ob); break;
+                case STRING:
+                case VECTOR:
+                case MAP:
+                case FUNCTION:
+                case ARRAY:
+                case MATRIX: payload = id(ob); break;
+                case SEQUENCE: skipped++; type = NIL; break;
+                default: type = NIL; break;
+            }
+            emit<uint8_t>(out, type);
+            emit<uint64_t>(out, payload);
+        }
+        void record(const Object& ob) {
+            switch (ob.type) {
+                case STRING:
+                case ROPE:
+                    emit<uint8_t>(records, STRING);
+                    text(records, textOf(ob));
+                    break;
+                case VECTOR:
+                    emit<uint8_t>(records, VECTOR);
+                    emit<uint32_t>(records, ob.vec->size());
+                    for (auto& m : *ob.vec) value(records, m);
+                    break;
+                case SLICE:
+                    emit<uint8_t>(records, VECTOR);
+                    emit<uint32_t>(records, ob.slice->size());
+                    for (size_t i = 0; i < ob.slice->size(); i++) value(records, ob.slice->get(i));
+                    break;
+                case MAP:
+                    emit<uint8_t>(records, MAP);
+                    emit<uint32_t>(records, ob.map->size());
+                    ob.map->forEach([&](const Object& k, const Object& v) {
+                        value(records, k);
+                        value(records, v);
+                    });
+                    break;
+                case FUNCTION:
+                    emit<uint8_t>(records, FUNCTION);
+                    emit<uint8_t>(records, ob.func->getNative() != nullptr);
+                    text(records, ob.func->getName());
+                    emit<uint32_t>(records, ob.func->getNative() != nullptr ? 0 : functions.size());
+                    if (ob.func->getNative() == nullptr)
+                        functions.push_back(ob.func);
+                    emit<uint32_t>(records, ob.func->upvalueCount());
+                    for (size_t i = 0; i < ob.func->upvalueCount(); i++) {
+                        text(records, ob.func->upvalueName(i));
+                        value(records, ob.func->upvalue(i));
+                    }
+                    break;
+                case ARRAY:
+                    emit<uint8_t>(records, ARRAY);
+                    emit<uint64_t>(records, ob.arr->size());
+                    emit<uint64_t>(records, data.size());
+                    data.insert(data.end(), (const char*)ob.arr->begin(), (const char*)ob.arr->end());
+                    break;
+                case MATRIX:
+                    emit<uint8_t>(records, MATRIX);
+                    emit<uint64_t>(records, ob.mat->rows());
+                    emit<uint64_t>(records, ob.mat->cols());
+                    emit<uint64_t>(records, data.size());
+                    data.insert(data.end(), (const char*)ob.mat->begin(), (const char*)ob.mat->end());
+                    break;
+                default: break;
+            }
+        }
+        //every script function as a definition in one program, sharing the live trees
+        vector<char> definitions() {
+            StatementList* defs = new StatementList(Token(TK_LCURLY, "{"), list<StatementNode*>());
+            for (auto func : functions) {
+                FuncDefStatement* ds = new FuncDefStatement(Token(TK_DEFINE, "def"));
+                ds->setName(func->getName());
+                ds->setParams(func->paramList());
+                ds->setBody(func->getBody());
+                ds->setMemoized(func->getMemo() != nullptr);
+                ds->setGenerator(func->isGenerator());
+                defs->addStatement(ds);
+            }
+            ProgramStatement* ps = new ProgramStatement(Token(TK_ID, "snapshot"));
+            ps->setProgram(defs);
+            vector<char> image = ImageWriter().write(ps);
+            //the trees belong to the functions, so they're detached before the wrappers go
+            for (auto stmt : defs->getStatements()) {
+                ((FuncDefStatement*)stmt)->setParams(nullptr);
+                ((FuncDefStatement*)stmt)->setBody(nullptr);
+            }
+            delete ps;
+            return image;
+        }
+    public:
+        size_t skipped = 0;
+        vector<char> write(Environment& globals) {
+            records.clear();
+            data.clear();
+            ids.clear();
+            pending.clear();
+            functions.clear();
+            skipped = 0;
+            vector<const pair<const string, Object>*> names;
+            for (auto& m : globals) names.push_back(&m);
+            sort(names.begin(), names.end(), [](auto a, auto b) { return a->first < b->first; });
+            vector<char> bindings;
+            for (auto m : names) {
+                text(bindings, m->first);
+                value(bindings, m->second);
+            }
+            //writing a record can discover more objects, which are appended to pending
+            for (size_t i = 0; i < pending.size(); i++) {
+                record(pending[i]);
+            }
+            vector<char> ast = definitions();
+            vector<char> image;
+            uint64_t globalsOffset = snapshotHeaderSize + records.size();
+            uint64_t astOffset = globalsOffset + bindings.size();
+            uint64_t dataOffset = (astOffset + ast.size() + 7) & ~(uint64_t)7;
+            emit<uint32_t>(image, snapshotMagic);
+            emit<uint32_t>(image, snapshotVersion);
+            emit<uint32_t>(image, pending.size());
+            emit<uint32_t>(image, names.size());
+            emit<uint64_t>(image, globalsOffset);
+            emit<uint64_t>(image, astOffset);
+            emit<uint64_t>(image, ast.size());
+            emit<uint64_t>(image, dataOffset);
+            image.insert(image.end(), records.begin(), records.end());
+            image.insert(image.end(), bindings.begin(), bindings.end());
+            image.insert(image.end(), ast.begin(), ast.end());
+            image.resize(dataOffset, 0);
+            image.insert(image.end(), data.begin(), data.end());
+            return image;
+        }
+        bool writeFile(Environment& globals, string filename) {
+            vector<char> image = write(globals);
+            ofstream out(filename, ios::binary);
+            if (!out) {
+                cout<<"Couldn't open "<<filename<<" for writing."<<endl;
+                return false;
+            }
+            out.write(image.data(), image.size());
+            if (skipped > 0)
+                cout<<skipped<<" sequences can't be saved, and were saved as nil."<<endl;
+            return out.good();
+        }
+};
+
+class SnapshotLoader {
+    private:
+        char* base;
+        size_t length;
+        size_t pos;
+        bool corrupt;
+        vector<Object> table;
+        vector<size_t> bodies;
+        template <typename T> T read() {
+            T value = T();
+            if (pos + sizeof(T) > length) {
+                pos = length;
+                corrupt = true;
+                return value;
+            }
+            memcpy(&value, base + pos, sizeof(T));
+            pos += sizeof(T);
+            return value;
+        }
+        string text() {
+            uint32_t len = read<uint32_t>();
+            if (pos + len > length) {
+                corrupt = true;
+                return string();
+            }
+            pos += len;
+            return string(base + pos - len, len);
+        }
+        Object value() {
+            ObjectType type = (ObjectType)read<uint8_t>();
+            uint64_t payload = read<uint64_t>();
+            switch (type) {
+                case NUMBER: {
+                    double d;
+                    memcpy(&d, &payload, sizeof(double));
+                    return Object(d);
+                }
+                case INTEGER: return Object((int64_t)payload);
+                case BOOL: return Object(payload != 0);
+                case NIL:  return Object();
+                default: break;
+            }
+            if (payload >= table.size()) {
+                corrupt = true;
+                return Object();
+            }
+            return table[payload];
+        }
+        //makes the object for each record; vectors & maps are filled in once they all exist
+        bool create(uint32_t count, InterpreterVisitor& iv, vector<FuncDefStatement*>& defs, uint64_t dataOffset) {
+            for (uint32_t i = 0; i < count && !corrupt; i++) {
+                bodies.push_back(pos);
+                ObjectType type = (ObjectType)read<uint8_t>();
+                switch (type) {
+                    case STRING: table.push_back(Object(text())); break;
+                    case VECTOR: {
+                        uint32_t n = read<uint32_t>();
+                        pos += n * (size_t)9;
+                        table.push_back(Object(new ObjectVector()));
+                    } break;
+                    case MAP: {
+                        uint32_t n = read<uint32_t>();
+                        pos += n * (size_t)18;
+                        table.push_back(Object(new ObjectMap(n)));
+                    } break;
+                    case FUNCTION: {
+                        bool native = read<uint8_t>();
+                        string name = text();
+                        uint32_t def = read<uint32_t>();
+                        //the values are filled in with the vectors' elements
+                        uint32_t n = read<uint32_t>();
+                        vector<Capture> captures;
+                        for (uint32_t k = 0; k < n && !corrupt; k++) {
+                            captures.push_back(Capture{text(), -1});
+                            pos += 9;
+                        }
+                        if (native) {
+                            auto it = iv.globals().find(name);
+                            if (it == iv.globals().end() || it->second.type != FUNCTION) {
+                                cout<<"Snapshot refers to a built-in "<<name<<" this interpreter doesn't have."<<endl;
+                                table.push_back(Object());
+                            } else table.push_back(it->second);
+                        } else if (def < defs.size() && defs[def] != nullptr) {
+                            FuncDefStatement* ds = defs[def];
+                            //the image holds bare trees, so where each name is read from is worked out again
+                            ds->setCaptures(std::move(captures));
+                            CaptureAnalysis().run(ds);
+                            table.push_back(Object(new Function(name, ds->getParams(), ds->getBody(), ds->isMemoized(), ds->isGenerator(), &ds->getCaptures())));
+                        } else corrupt = true;
+                    } break;
+                    case ARRAY: {
+                        uint64_t n = read<uint64_t>();
+                        uint64_t offset = read<uint64_t>();
+                        if (dataOffset + offset + n * sizeof(double) > length) corrupt = true;
+                        else table.push_back(Object(new NumArray((double*)(base + dataOffset + offset), n)));
+                    } break;
+                    case MATRIX: {
+                        uint64_t rows = read<uint64_t>();
+                        uint64_t cols = read<uint64_t>();
+                        uint64_t offset = read<uint64_t>();
+                        if (cols != 0 && rows > (length / sizeof(double)) / cols) corrupt = true;
+                        else if (dataOffset + offset + rows * cols * sizeof(double) > length) corrupt = true;
+                        else {
+                            Matrix* m = new Matrix(rows, cols);
+                            memcpy(m->begin(), base + dataOffset + offset, rows * cols * sizeof(double));
+                            table.push_back(Object(m));
+                        }
+                    } break;
+                    default: corrupt = true; break;
+                }
+            }
+            return !corrupt;
+        }
+        void fill() {
+            for (size_t i = 0; i < table.size() && !corrupt; i++) {
+                Object& ob = table[i];
+                if (ob.type == FUNCTION && ob.func->upvalueCount() > 0) {
+                    pos = bodies[i] + 1;
+                    read<uint8_t>();
+                    text();
+                    read<uint32_t>();
+                    uint32_t n = read<uint32_t>();
+                    for (uint32_t k = 0; k < n && k < ob.func->upvalueCount(); k++) {
+                        text();
+                        ob.func->upvalue(k) = value();
+                    }
+                    continue;
+                }
+                if (ob.type != VECTOR && ob.type != MAP)
+                    continue;
+                pos = bodies[i] + 1;
+                uint32_t n = read<uint32_t>();
+                if (ob.type == VECTOR) {
+                    ob.vec->reserve(n);
+                    for (uint32_t k = 0; k < n; k++) ob.vec->push_back(value());
+                } else {
+                    for (uint32_t k = 0; k < n; k++) {
+                        Object key = value();
+                        ob.map->set(key, value());
+                    }
+                }
+            }
+        }
+    public:
+        SnapshotLoader() : base(nullptr), length(0), pos(0), corrupt(false) { }
+        //binds every global in the snapshot in iv, returning false if it couldn't be read
+        bool restore(InterpreterVisitor& iv, char* image, size_t len) {
+            base = image;
+            length = len;
+            pos = 0;
+            corrupt = false;
+            table.clear();
+            bodies.clear();
+            if (length < snapshotHeaderSize || read<uint32_t>() != snapshotMagic) {
+                cout<<"Not a snapshot."<<endl;
+                return false;
+            }
+            if (read<uint32_t>() != snapshotVersion) {
+                cout<<"Unsupported snapshot version."<<endl;
+                return false;
+            }
+            uint32_t recordCount = read<uint32_t>();
+            uint32_t globalCount = read<uint32_t>();
+            uint64_t globalsOffset = read<uint64_t>();
+            uint64_t astOffset = read<uint64_t>();
+            uint64_t astLength = read<uint64_t>();
+            uint64_t dataOffset = read<uint64_t>();
+            if (astOffset + astLength > length || dataOffset > length || globalsOffset > astOffset) {
+                cout<<"Corrupt snapshot header."<<endl;
+                return false;
+            }
+            //the definitions' trees become the functions' bodies, so the program is never freed
+            ProgramStatement* program = ImageLoader().load(base + astOffset, astLength);
+            if (program == nullptr)
+                return false;
+            vector<FuncDefStatement*> defs;
+            for (auto stmt : program->getStatement()->getStatements()) {
+                defs.push_back(dynamic_cast<FuncDefStatement*>(stmt));
+            }
+            pos = snapshotHeaderSize;
+            if (!create(recordCount, iv, defs, dataOffset)) {
+                cout<<"Corrupt snapshot near offset "<<pos<<endl;
+                return false;
+            }
+            fill();
+            pos = globalsOffset;
+            vector<pair<string, Object>> bindings;
+            for (uint32_t i = 0; i < globalCount && !corrupt; i++) {
+                string name = text();
+                bindings.emplace_back(std::move(name), value());
+            }
+            if (corrupt) {
+                cout<<"Corrupt snapshot near offset "<<pos<<endl;
+                return false;
+            }
+            //nothing is bound until the whole snapshot has been read
+            for (auto& m : bindings) {
+                iv.define(m.first, m.second);
+            }
+            return true;
+        }
+        //maps the file privately, so arrays can use their elements where they lie
+        bool restoreFile(InterpreterVisitor& iv, string filename) {
+            int fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                cout<<"Couldn't open "<<filename<<endl;
+                return false;
+            }
+            struct stat sb;
+            if (fstat(fd, &sb) < 0 || sb.st_size == 0) {
+                close(fd);
+                cout<<"Not a snapshot."<<endl;
+                return false;
+            }
+            void* mapping = mmap(nullptr, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (mapping == MAP_FAILED) {
+                cout<<"Couldn't map "<<filename<<endl;
+                return false;
+            }
+            bool ok = restore(iv, (char*)mapping, sb.st_size);
+            bool arrays = false;
+            for (auto& ob : table) arrays = arrays || ob.type == ARRAY;
+            //arrays point into the mapping, which then lives as long as they do: for good
+            if (!ok || !arrays)
+                munmap(mapping, sb.st_size);
+            return ok;
+        }
+};
+
+#endif
@@ -6,7 +6,8 @@
 #include "object.hpp"
 using namespace std;
 
-typedef unordered_map<string, Object> Environment;
+typedef unordered_map<string, Object, hash<string>, equal_to<string>,
+                      TrackingAllocator<pair<const string, Object>, MEM_ENVIRONMENT>> Environment;
 
 class ASTNode;
 class ExpressionNode;
@@ -17,8 +18,10 @@ class StatementList;
 class ParameterList;
 class PrintStatement;
 class WhileStatement;
+class ForStatement;
 class FuncDefStatement;
 class ReturnStatement;
+class YieldStatement;
 class VarDefStatement;
 class IfStatement;
 class ExprStatement;
@@ -27,69 +30,103 @@ class IdExpression;
 class BinaryExpression;
 class UnaryExpression;
 class ListExpression;
+class MapExpression;
 class SubscriptExpression;
+class SliceExpression;
 class RelOpExpression;
 class AssignExpression;
+class IncrementExpression;
 class FunctionCall;
 
-//Abstract Visitor Interface
+/*
+    Abstract Visitor Interface.
+    Each visit returns an R, so a visitor that computes values, like the interpreter,
+    hands them straight back to whoever asked instead of through a stack of its own.
+    Visitors that only walk or rewrite the tree are Visitor<>, returning nothing.
+    Every node has an accept() for each R in use: void & Object.
+*/
+template <class R = void>
 class Visitor {
     public:
-        virtual void visit(PrintStatement* ps) = 0;
-        virtual void visit(WhileStatement* ws) = 0;
-        virtual void visit(ExprStatement* es) = 0;
-        virtual void visit(ProgramStatement* ps) = 0;
-        virtual void visit(StatementList* sl) = 0;
-        virtual void visit(ParameterList* pl) = 0;
-        virtual void visit(IfStatement* is) = 0;
-        virtual void visit(FuncDefStatement* ds) = 0;
-        virtual void visit(ReturnStatement* rs) = 0;
-        virtual void visit(VarDefStatement* vd) = 0;
-        virtual void visit(IdExpression* idexpr) = 0;
-        virtual void visit(LiteralExpression* litexpr) = 0;
-        virtual void visit(AssignExpression* assignExpr) = 0;
-        virtual void visit(BinaryExpression* binexpr) = 0;
-        virtual void visit(RelOpExpression* relexpr) = 0;
-        virtual void visit(UnaryExpression* unaryexpr) = 0;
-        virtual void visit(FunctionCall* func) = 0;
-        virtual void visit(ListExpression* le) = 0;
-        virtual void visit(SubscriptExpression* se) = 0;
+        virtual ~Visitor() { }
+        virtual R visit(PrintStatement* ps) = 0;
+        virtual R visit(WhileStatement* ws) = 0;
+        virtual R visit(ForStatement* fs) = 0;
+        virtual R visit(ExprStatement* es) = 0;
+        virtual R visit(ProgramStatement* ps) = 0;
+        virtual R visit(StatementList* sl) = 0;
+        virtual R visit(ParameterList* pl) = 0;
+        virtual R visit(IfStatement* is) = 0;
+        virtual R visit(FuncDefStatement* ds) = 0;
+        virtual R visit(ReturnStatement* rs) = 0;
+        virtual R visit(YieldStatement* ys) = 0;
+        virtual R visit(VarDefStatement* vd) = 0;
+        virtual R visit(IdExpression* idexpr) = 0;
+        virtual R visit(LiteralExpression* litexpr) = 0;
+        virtual R visit(AssignExpression* assignExpr) = 0;
+        virtual R visit(IncrementExpression* incExpr) = 0;
+        virtual R visit(BinaryExpression* binexpr) = 0;
+        virtual R visit(RelOpExpression* relexpr) = 0;
+        virtual R visit(UnaryExpression* unaryexpr) = 0;
+        virtual R visit(FunctionCall* func) = 0;
+        virtual R visit(ListExpression* le) = 0;
+        virtual R visit(MapExpression* me) = 0;
+        virtual R visit(SubscriptExpression* se) = 0;
+        virtual R visit(SliceExpression* se) = 0;
 };
 
 //Base AST Class
-class ASTNode {
+class ASTNode : public Tracked<MEM_AST> {
     private:
         Token token;
     public:
-        ASTNode(Token tok) : token(tok) { }
-        Token getToken() {
+        ASTNode(Token tok) : token(std::move(tok)) { }
+        virtual ~ASTNode() { }
+        const Token& getToken() const {
             return token;
         }
-        virtual void accept(Visitor* visitor) = 0;
+        virtual void accept(Visitor<>* visitor) = 0;
+        virtual Object accept(Visitor<Object>* visitor) = 0;
+};
+
+//What the type checker could prove about the value of an expression; ST_NUMBER is a double
+enum StaticType {
+    ST_ANY, ST_NUMBER, ST_INTEGER, ST_BOOL, ST_STRING, ST_FUNCTION, ST_VECTOR, ST_MAP, ST_NIL
+};
+
+inline string staticTypeStr[] = {
+    "any", "number", "integer", "bool", "string", "function", "vector", "map", "nil"
 };
 
 //Base Expr Class
 class ExpressionNode : public ASTNode {
+    private:
+        StaticType type;
     public:
-        ExpressionNode(Token tok) : ASTNode(tok) { }
+        ExpressionNode(Token tok) : ASTNode(std::move(tok)), type(ST_ANY) { }
         virtual ~ExpressionNode() { }
+        StaticType getType() const { return type; }
+        void setType(StaticType st) { type = st; }
+        bool isNumeric() const { return type == ST_NUMBER; }
+        bool isInteger() const { return type == ST_INTEGER; }
 };
 
 //Base Stmt Class
 class StatementNode : public ASTNode {
     public:
-        StatementNode(Token tok) : ASTNode(tok) { }
+        StatementNode(Token tok) : ASTNode(std::move(tok)) { }
         virtual ~StatementNode() { }
 };
 
-class StatementList : StatementNode {
+class StatementList : public StatementNode {
     private:
         list<StatementNode*> statements;
     public:
-        StatementList(Token tk, list<StatementNode*> stmts) : StatementNode(tk), statements(stmts) { }
+        StatementList(Token tk, list<StatementNode*> stmts) : StatementNode(std::move(tk)), statements(std::move(stmts)) { }
         list<StatementNode*>& getStatements() { return statements; }
         void addStatement(StatementNode* stmt) { statements.push_back(stmt); }
-        void accept(Visitor* visit) { visit->visit(this); }
+        void accept(Visitor<>* visit) { visit->visit(this); }
+        Object accept(Visitor<Object>* visit) { return visit->visit(this); }
         ~StatementList() {
             for (StatementNode* stmt : statements) {
                 delete stmt;
@@ -102,10 +139,11 @@ class ParameterList : public StatementNode {
         list<StatementNode*> params;
     public:
         ParameterList(Token token) : StatementNode(token) { }
-        list<StatementNode*> getParams() { return params; }
+        list<StatementNode*>& getParams() { return params; }
         void setParams(list<StatementNode*>& p) { params = p; }
         void add(StatementNode* sn) { params.push_back(sn); }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
 };
 
 class ProgramStatement : public StatementNode {
@@ -115,7 +153,8 @@ class ProgramStatement : public StatementNode {
         ProgramStatement(Token token) : StatementNode(token) { }
         void setProgram(StatementList* sn) { statementList = sn; }
         StatementList* getStatement() { return statementList; }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
         ~ProgramStatement() {
             delete statementList;
         }
@@ -128,7 +167,8 @@ class PrintStatement : public StatementNode {
         PrintStatement(Token token) : StatementNode(token) { }
         void setExpression(ExpressionNode* expr) { expression = expr; }
         ExpressionNode* getExpression() { return expression; }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
         ~PrintStatement() {
             delete expression;
         }
@@ -144,13 +184,35 @@ class WhileStatement : public StatementNode {
         void setLoopBody(StatementList* stmt) { body = stmt; }
         ExpressionNode* getTestExpr() { return testExpr; }
         StatementList* getLoopBody() { return body; }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
         ~WhileStatement() {
             delete testExpr;
             delete body;
         }
 };
 
+class ForStatement : public StatementNode {
+    private:
+        string varname;
+        ExpressionNode* iterable;
+        StatementList* body;
+    public:
+        ForStatement(Token token) : StatementNode(token) { }
+        void setVarName(string n) { varname = std::move(n); }
+        void setIterable(ExpressionNode* expr) { iterable = expr; }
+        void setLoopBody(StatementList* stmt) { body = stmt; }
+        const string& getVarName() const { return varname; }
+        ExpressionNode* getIterable() { return iterable; }
+        StatementList* getLoopBody() { return body; }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
+        ~ForStatement() {
+            delete iterable;
+            delete body;
+        }
+};
+
 class IfStatement : public StatementNode {
     private:
         ExpressionNode* testExpr;
@@ -164,7 +226,8 @@ class IfStatement : public StatementNode {
         StatementList* getPassCase() { return trCase; }
         StatementList* getFailCase() { return faCase; }
         ExpressionNode* getTest() { return testExpr; }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
         ~IfStatement() {
             delete testExpr;
             delete trCase;
@@ -181,11 +244,26 @@ class VarDefStatement : public StatementNode {
         VarDefStatement(Token tk) : StatementNode(tk) { }
         bool isInitialized() { return initialized; }
         void setInitialized(bool v) { initialized = v; }
-        void setName(string n) { varname = n; }
-        string getName() { return varname; }
+        void setName(string n) { varname = std::move(n); }
+        const string& getName() const { return varname; }
         void setExpr(ExpressionNode* e) { expr = e; }
         ExpressionNode* getExpr() { return expr; }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
+};
+
+//A variable a nested function copies out of the function that defines it, when the def runs
+struct Capture {
+    string name;
+    int from;       //the definer's own upvalue slot holding it, or -1 for one of its locals
+};
+
+class FuncDefStatement;
+
+//A sibling defined earlier in the same body, which captured this function's name before its def ran
+struct ForwardCapture {
+    FuncDefStatement* def;
+    int slot;       //where the sibling's closure holds it
 };
 
 class FuncDefStatement : public StatementNode {
@@ -193,15 +271,29 @@ class FuncDefStatement : public StatementNode {
         string name;
         ParameterList* params;
         StatementList* body;
+        bool memoize;
+        bool generator;
+        vector<Capture> captures;
+        vector<ForwardCapture> forwards;
     public:
-        FuncDefStatement(Token tk) : StatementNode(tk) { }
+        FuncDefStatement(Token tk) : StatementNode(tk), params(nullptr), body(nullptr), memoize(false), generator(false) { }
+        bool isMemoized() { return memoize; }
+        void setMemoized(bool m) { memoize = m; }
+        bool isGenerator() { return generator; }
+        void setGenerator(bool g) { generator = g; }
         ParameterList* getParams() { return params; }
         StatementList* getBody() { return body; }
-        string getName() { return name; }
+        const string& getName() const { return name; }
         void setParams(ParameterList* sl) { params = sl; }
         void setBody(StatementList* sl) { body = sl; }
-        void setName(string nm) { name = nm; }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        void setName(string nm) { name = std::move(nm); }
+        const vector<Capture>& getCaptures() const { return captures; }
+        void setCaptures(vector<Capture> caps) { captures = std::move(caps); }
+        const vector<ForwardCapture>& getForwards() const { return forwards; }
+        void addForward(ForwardCapture fwd) { forwards.push_back(fwd); }
+        void clearForwards() { forwards.clear(); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
         ~FuncDefStatement() {
             delete params;
             delete body;
@@ -212,12 +304,25 @@ class ReturnStatement : public StatementNode {
     private:
         ExpressionNode* retVal;
     public:
-        ReturnStatement(Token tk) : StatementNode(tk) { }
+        ReturnStatement(Token tk) : StatementNode(tk), retVal(nullptr) { }
         void setRetVal(ExpressionNode* expr) { retVal = expr; }
         ExpressionNode* getRetVal() { return retVal; }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
  };
 
+//Hands a value to whoever is iterating the generator, suspending it until the next one is wanted
+class YieldStatement : public StatementNode {
+    private:
+        ExpressionNode* value;
+    public:
+        YieldStatement(Token tk) : StatementNode(tk), value(nullptr) { }
+        void setValue(ExpressionNode* expr) { value = expr; }
+        ExpressionNode* getValue() { return value; }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
+};
+
 class ExprStatement : public StatementNode {
     private:
         ExpressionNode* expr;
@@ -225,32 +330,47 @@ class ExprStatement : public StatementNode {
         ExprStatement(Token token) : StatementNode(token) { }
         void setExpr(ExpressionNode* expression) { expr = expression; }
         ExpressionNode* getExpression() { return expr; }
-        void accept(Visitor* visitor) {visitor->visit(this); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
         ~ExprStatement() { delete expr; }
 };
 
 class IdExpression : public ExpressionNode {
+    private:
+        int upvalue = -1;
     public:
         IdExpression(Token token) : ExpressionNode(token) { }
-        string getId() { return getToken().lexeme; }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        const string& getId() const { return getToken().lexeme; }
+        //the slot of a captured variable in the enclosing function's upvalues, or -1 to look it up by name
+        int getUpvalue() const { return upvalue; }
+        void setUpvalue(int slot) { upvalue = slot; }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
         ~IdExpression() { }
 };
 
 class LiteralExpression : public ExpressionNode {
-    public:
-        LiteralExpression(Token token) : ExpressionNode(token) { }
-        Object eval(Environment& e) { 
+    private:
+        Object value;
+        Object decode() {
             switch (getToken().type) {
-                case TK_NUMBER: return Object(std::stod(getToken().lexeme));
-                case TK_STRING: return Object(getToken().lexeme);
-                case TK_TRUE:   return Object(true);
-                case TK_FALSE:  return Object(false);
+                case TK_NUMBER:  return Object(std::stod(getToken().lexeme));
+                case TK_INTEGER: return Object((int64_t)std::stoll(getToken().lexeme));
+                case TK_STRING:  return Object(getToken().lexeme);
+                case TK_TRUE:    return Object(true);
+                case TK_FALSE:   return Object(false);
                 default: break;
             }
             return Object();
         }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+    public:
+        LiteralExpression(Token token) : ExpressionNode(token) { value = decode(); }
+        LiteralExpression(Token token, Object val) : ExpressionNode(token), value(val) { }
+        const Object& eval(Environment& e) const { 
+            return value;
+        }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
         ~LiteralExpression() { }
 };
 
@@ -259,23 +379,64 @@ class ListExpression : public ExpressionNode {
         list<ExpressionNode*> exprs;
     public:
         ListExpression(Token tk) : ExpressionNode(tk) { }
-        void setExprsList(list<ExpressionNode*> l) { exprs = l; }
+        void setExprsList(list<ExpressionNode*> l) { exprs = std::move(l); }
         list<ExpressionNode*>& getExprsList() { return exprs; }
         void addExpr(ExpressionNode* e) { exprs.push_back(e); }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
+};
+
+class MapExpression : public ExpressionNode {
+    private:
+        list<pair<ExpressionNode*, ExpressionNode*>> entries;
+    public:
+        MapExpression(Token tk) : ExpressionNode(tk) { }
+        void addEntry(ExpressionNode* key, ExpressionNode* value) { entries.push_back(make_pair(key, value)); }
+        list<pair<ExpressionNode*, ExpressionNode*>>& getEntries() { return entries; }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
+        ~MapExpression() {
+            for (auto& entry : entries) {
+                delete entry.first;
+                delete entry.second;
+            }
+        }
 };
 
 class SubscriptExpression : public ExpressionNode {
     private:
-        IdExpression* name;
+        ExpressionNode* name;
         ExpressionNode* position;
     public:
         SubscriptExpression(Token tk) : ExpressionNode(tk) { }
-        void setName(IdExpression* expr) { name = expr; }
-        IdExpression* getName() { return name; }
+        //any expression yielding a container, so subscripts can be chained: m[i][j]
+        void setName(ExpressionNode* expr) { name = expr; }
+        ExpressionNode* getName() { return name; }
         void setPosition(ExpressionNode* expr) { position = expr; }
         ExpressionNode* getPosition() { return position; }
-        void accept(Visitor* visit) { visit->visit(this); }
+        void accept(Visitor<>* visit) { visit->visit(this); }
+        Object accept(Visitor<Object>* visit) { return visit->visit(this); }
+};
+
+//name[from:to:stride], where any of the three may be left out
+class SliceExpression : public ExpressionNode {
+    private:
+        ExpressionNode* name;
+        ExpressionNode* from;
+        ExpressionNode* to;
+        ExpressionNode* stride;
+    public:
+        SliceExpression(Token tk) : ExpressionNode(tk), name(nullptr), from(nullptr), to(nullptr), stride(nullptr) { }
+        void setName(ExpressionNode* expr) { name = expr; }
+        ExpressionNode* getName() { return name; }
+        void setFrom(ExpressionNode* expr) { from = expr; }
+        ExpressionNode* getFrom() { return from; }
+        void setTo(ExpressionNode* expr) { to = expr; }
+        ExpressionNode* getTo() { return to; }
+        void setStride(ExpressionNode* expr) { stride = expr; }
+        ExpressionNode* getStride() { return stride; }
+        void accept(Visitor<>* visit) { visit->visit(this); }
+        Object accept(Visitor<Object>* visit) { return visit->visit(this); }
 };
 
 class UnaryExpression : public ExpressionNode {
@@ -285,7 +446,8 @@ class UnaryExpression : public ExpressionNode {
         UnaryExpression(Token tk) : ExpressionNode(tk) { }
         void setLeft(ExpressionNode* expr) { left = expr; }
         ExpressionNode* getLeft() { return left; }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
         ~UnaryExpression() {
             delete left;
         }
@@ -301,9 +463,12 @@ class BinaryExpression : public ExpressionNode {
         void setRight(ExpressionNode* rr) { right = rr; }
         ExpressionNode* getLeft() { return left; }
         ExpressionNode* getRight() { return right; }
-        void accept(Visitor* visitor) {
+        void accept(Visitor<>* visitor) {
             visitor->visit(this);
         }
+        Object accept(Visitor<Object>* visitor) {
+            return visitor->visit(this);
+        }
         ~BinaryExpression() {
             delete left;
             delete right;
@@ -320,9 +485,12 @@ class RelOpExpression : public ExpressionNode {
         void setRight(ExpressionNode* rr) { right = rr; }
         ExpressionNode* getLeft() { return left; }
         ExpressionNode* getRight() { return right; }
-        void accept(Visitor* visitor) {
+        void accept(Visitor<>* visitor) {
             visitor->visit(this);
         }
+        Object accept(Visitor<Object>* visitor) {
+            return visitor->visit(this);
+        }
         ~RelOpExpression() {
             delete left;
             delete right;
@@ -339,13 +507,32 @@ class AssignExpression : public ExpressionNode {
         void setRight(ExpressionNode* expr) { right = expr; }
         ExpressionNode* getLeft() { return left; }
         ExpressionNode* getRight() { return right; }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
         ~AssignExpression() {
             delete left;
             delete right;
         }
 };
 
+//'id := id + c' fused into a single node by the loop optimizer; c is an integer or a number
+class IncrementExpression : public ExpressionNode {
+    private:
+        IdExpression* target;
+        Object delta;
+    public:
+        IncrementExpression(Token tk) : ExpressionNode(tk) { }
+        void setTarget(IdExpression* id) { target = id; }
+        void setDelta(const Object& d) { delta = d; }
+        IdExpression* getTarget() { return target; }
+        const Object& getDelta() { return delta; }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
+        ~IncrementExpression() {
+            delete target;
+        }
+};
+
 class FunctionCall : public ExpressionNode {
     private:
         IdExpression* name;
@@ -353,10 +540,11 @@ class FunctionCall : public ExpressionNode {
     public:
         FunctionCall(Token tok) : ExpressionNode(tok) { }
         void setName(IdExpression* expr) { name = expr; }
-        void setArgs(list<ExpressionNode*> args) { arguments = args; }
+        void setArgs(list<ExpressionNode*> args) { arguments = std::move(args); }
         IdExpression* getName() { return name; }
         list<ExpressionNode*>& getArgs() { return arguments; }
-        void accept(Visitor* visitor) { visitor->visit(this); }
+        void accept(Visitor<>* visitor) { visitor->visit(this); }
+        Object accept(Visitor<Object>* visitor) { return visitor->visit(this); }
 };
 
 
@@ -4,25 +4,25 @@
 using std::string;
 
 enum TokenType {
-    TK_NUMBER, TK_ID, TK_STRING, TK_ASSIGN, TK_LPAREN, TK_RPAREN, TK_LCURLY, TK_RCURLY, TK_LBRACK, TK_RBRACK, TK_COMA,
+    TK_NUMBER, TK_INTEGER, TK_ID, TK_STRING, TK_ASSIGN, TK_LPAREN, TK_RPAREN, TK_LCURLY, TK_RCURLY, TK_LBRACK, TK_RBRACK, TK_COMA,
     TK_PLUS, TK_MINUS, TK_MULT, TK_DIV, TK_EQU, TK_NEQ, TK_LT, TK_LTE, TK_GT, TK_GTE, 
-    TK_PRINT, TK_WHILE, TK_IF, TK_ELSE, TK_DEFINE, 
-    TK_RETURN, TK_VAR, TK_TRUE, TK_FALSE, TK_NOT, TK_SEMI,
+    TK_PRINT, TK_WHILE, TK_FOR, TK_IN, TK_IF, TK_ELSE, TK_DEFINE, TK_MEMO, 
+    TK_RETURN, TK_YIELD, TK_VAR, TK_TRUE, TK_FALSE, TK_NOT, TK_SEMI, TK_COLON,
     TK_NIL, TK_EOF, TK_ERR
 };
 
 inline string tokenStr[] = {
-    "TK_NUMBER", "TK_ID", "TK_STRING", "TK_ASSIGN", "TK_LPAREN", "TK_RPAREN", "TK_LCURLY", "TK_RCURLY","TK_LBRACK", "TK_RBRACK", "TK_COMA",
+    "TK_NUMBER", "TK_INTEGER", "TK_ID", "TK_STRING", "TK_ASSIGN", "TK_LPAREN", "TK_RPAREN", "TK_LCURLY", "TK_RCURLY","TK_LBRACK", "TK_RBRACK", "TK_COMA",
     "TK_PLUS", "TK_MINUS", "TK_MULT", "TK_DIV", "TK_EQU", "TK_NEQ", "TK_LT", "TK_LTE", "TK_GT", "TK_GTE", 
-    "TK_PRINT", "TK_WHILE", "TK_IF", "TK_ELSE", 
-    "TK_DEFINE", "TK_RETURN", "TK_VAR", "TK_TRUE", "TK_FALSE", "TK_NOT", "TK_SEMI",
+    "TK_PRINT", "TK_WHILE", "TK_FOR", "TK_IN", "TK_IF", "TK_ELSE", 
+    "TK_DEFINE", "TK_MEMO", "TK_RETURN", "TK_YIELD", "TK_VAR", "TK_TRUE", "TK_FALSE", "TK_NOT", "TK_SEMI", "TK_COLON",
     "TK_NIL", "TK_EOF", "TK_ERR"
 };
 
 struct Token {
     TokenType type;
     string lexeme;
-    Token(TokenType tt = TK_NIL, string str = "nil") : type(tt), lexeme(str) { }
+    Token(TokenType tt = TK_NIL, string str = "nil") : type(tt), lexeme(std::move(str)) { }
 };
 
 bool isRelOp(TokenType token) {
@@ -0,0 +1,266 @@
+#ifndef typechecker_hpp
+#define typechecker_hpp
+#include <iostream>
+#include <list>
+#include <unordered_map>
+#include "token.hpp"
+#include "syntaxtree.hpp"
+using namespace std;
+
+/*
+    Infers the type of every expression by following assignments in execution order,
+    & reports operations that can only produce garbage, before anything runs.
+    Types are only tracked for names bound in the scope being checked: any other name is a
+    global or a captured variable, which may be rebound between calls, & is typed ST_ANY.
+    Branches & loop bodies may or may not run, so where they disagree a name becomes ST_ANY.
+    Expressions left annotated ST_NUMBER or ST_INTEGER can be evaluated without checking tags
+    at run time. Integers & doubles mix freely, but a name that may hold either is ST_ANY.
+*/
+class TypeChecker : public Visitor<> {
+    private:
+        typedef unordered_map<string, StaticType> TypeEnv;
+        TypeEnv vars;
+        StaticType type = ST_ANY;
+        StaticType check(ExpressionNode* expr) {
+            type = ST_ANY;
+            if (expr != nullptr) {
+                expr->accept(this);
+                expr->setType(type);
+            }
+            return type;
+        }
+        void check(StatementNode* stmt) {
+            if (stmt != nullptr)
+                stmt->accept(this);
+        }
+        void error(ASTNode* node, const string& msg) {
+            errors.push_back("type error at '" + node->getToken().lexeme + "': " + msg);
+        }
+        static bool known(StaticType st) { return st != ST_ANY; }
+        static bool numeric(StaticType st) { return st == ST_NUMBER || st == ST_INTEGER; }
+        static TypeEnv join(const TypeEnv& lhs, const TypeEnv& rhs) {
+            TypeEnv merged;
+            for (auto& m : lhs) {
+                auto it = rhs.find(m.first);
+                merged[m.first] = (it != rhs.end() && it->second == m.second) ? m.second : ST_ANY;
+            }
+            for (auto& m : rhs) {
+                if (lhs.find(m.first) == lhs.end())
+                    merged[m.first] = ST_ANY;
+            }
+            return merged;
+        }
+        //a loop body runs any number of times, so it is checked until the names it binds settle.
+        //each pass can only move a name toward ST_ANY, so this always ends, & the unboxed
+        //paths may only trust types taken from the settled pass.
+        void loop(ExpressionNode* test, const string& var, StatementList* body) {
+            size_t reported = errors.size();
+            for (;;) {
+                errors.resize(reported);
+                TypeEnv before = vars;
+                if (test != nullptr) checkTest(test);
+                if (!var.empty()) vars[var] = ST_ANY;
+                check(body);
+                vars = join(before, vars);
+                if (vars == before)
+                    break;
+            }
+        }
+        void checkTest(ExpressionNode* test) {
+            StaticType st = check(test);
+            if (known(st) && st != ST_BOOL)
+                error(test, "condition is a " + staticTypeStr[st] + ", not a bool");
+        }
+    public:
+        list<string> errors;
+        void report(ostream& os) {
+            for (auto& msg : errors)
+                os<<msg<<endl;
+        }
+        //names bound by a program that failed to check are forgotten, as it won't be run
+        void visit(ProgramStatement* ps) override {
+            TypeEnv before = vars;
+            errors.clear();
+            check(ps->getStatement());
+            if (!errors.empty())
+                vars = std::move(before);
+        }
+        void visit(StatementList* sl) override {
+            for (auto m : sl->getStatements()) {
+                check(m);
+            }
+        }
+        void visit(ParameterList* pl) override { }
+        void visit(PrintStatement* ps) override {
+            check(ps->getExpression());
+        }
+        void visit(WhileStatement* ws) override {
+            loop(ws->getTestExpr(), "", ws->getLoopBody());
+        }
+        void visit(ForStatement* fs) override {
+            StaticType st = check(fs->getIterable());
+            if (known(st) && st != ST_VECTOR)
+                error(fs, "can only iterate over vectors & sequences, not a " + staticTypeStr[st]);
+            loop(nullptr, fs->getVarName(), fs->getLoopBody());
+        }
+        void visit(IfStatement* is) override {
+            checkTest(is->getTest());
+            TypeEnv before = vars;
+            check(is->getPassCase());
+            TypeEnv passed = std::move(vars);
+            vars = before;
+            check(is->getFailCase());
+            vars = join(passed, vars);
+        }
+        void visit(FuncDefStatement* ds) override {
+            vars[ds->getName()] = ST_FUNCTION;
+            //the body runs in its own scope, where only the parameters are bound
+            TypeEnv outer = std::move(vars);
+            vars = TypeEnv();
+            if (ds->getParams() != nullptr) {
+                for (auto m : ds->getParams()->getParams()) {
+                    VarDefStatement* vd = dynamic_cast<VarDefStatement*>(m);
+                    if (vd != nullptr) vars[vd->getName()] = ST_ANY;
+                }
+            }
+            check(ds->getBody());
+            vars = std::move(outer);
+        }
+        void visit(ReturnStatement* rs) override {
+            check(rs->getRetVal());
+        }
+        void visit(YieldStatement* ys) override {
+            check(ys->getValue());
+        }
+        void visit(VarDefStatement* vd) override {
+            vars[vd->getName()] = ST_NIL;
+            check(vd->getExpr());
+        }
+        void visit(ExprStatement* es) override {
+            check(es->getExpression());
+        }
+        void visit(IdExpression* idexpr) override {
+            auto it = vars.find(idexpr->getId());
+            type = it == vars.end() ? ST_ANY : it->second;
+        }
+        void visit(LiteralExpression* lit) override {
+            switch (lit->getToken().type) {
+                case TK_NUMBER:  type = ST_NUMBER; break;
+                case TK_INTEGER: type = ST_INTEGER; break;
+                case TK_STRING:  type = ST_STRING; break;
+                case TK_TRUE:
+                case TK_FALSE:   type = ST_BOOL; break;
+                default:         type = ST_NIL; break;
+            }
+        }
+        void visit(AssignExpression* assign) override {
+            StaticType st = check(assign->getRight());
+            if (assign->getLeft()->getToken().type == TK_ID) {
+                vars[assign->getLeft()->getToken().lexeme] = st;
+            } else {
+                check(assign->getLeft());
+            }
+            type = ST_NIL;
+        }
+        void visit(IncrementExpression* inc) override {
+            StaticType st = check(inc->getTarget());
+            if (known(st) && !numeric(st))
+                error(inc->getTarget(), "can't step a " + staticTypeStr[st]);
+            StaticType stepped = inc->getDelta().type == INTEGER ? st : ST_NUMBER;
+            vars[inc->getTarget()->getId()] = known(st) ? stepped : ST_ANY;
+            type = ST_NIL;
+        }
+        void visit(BinaryExpression* bin) override {
+            StaticType lhs = check(bin->getLeft());
+            StaticType rhs = check(bin->getRight());
+            //'+' joins text to anything, so a '+' involving an unknown might not be a number
+            if (bin->getToken().type == TK_PLUS) {
+                if (lhs == ST_STRING || rhs == ST_STRING) {
+                    type = ST_STRING;
+                    return;
+                }
+                if (!known(lhs) || !known(rhs)) {
+                    if ((known(lhs) && !numeric(lhs)) || (known(rhs) && !numeric(rhs)))
+                        error(bin, "arithmetic on " + staticTypeStr[lhs] + " and " + staticTypeStr[rhs]);
+                    type = ST_ANY;
+                    return;
+                }
+            }
+            if ((known(lhs) && !numeric(lhs)) || (known(rhs) && !numeric(rhs)))
+                error(bin, "arithmetic on " + staticTypeStr[lhs] + " and " + staticTypeStr[rhs]);
+            //an unknown operand may be a matrix, which makes the result one too
+            if (!numeric(lhs) || !numeric(rhs))
+                type = ST_ANY;
+            else if (lhs == ST_INTEGER && rhs == ST_INTEGER && bin->getToken().type != TK_DIV)
+                type = ST_INTEGER;
+            else type = ST_NUMBER;
+        }
+        void visit(RelOpExpression* rel) override {
+            StaticType lhs = check(rel->getLeft());
+            StaticType rhs = check(rel->getRight());
+            TokenType op = rel->getToken().type;
+            bool ordering = op != TK_EQU && op != TK_NEQ;
+            if (known(lhs) && known(rhs) && lhs != rhs && !(numeric(lhs) && numeric(rhs))) {
+                error(rel, "comparing " + staticTypeStr[lhs] + " with " + staticTypeStr[rhs]);
+            } else if (ordering) {
+                for (StaticType st : { lhs, rhs }) {
+                    if (st == ST_FUNCTION || st == ST_VECTOR || st == ST_MAP) {
+                        error(rel, "a " + staticTypeStr[st] + " has no ordering");
+                        break;
+                    }
+                }
+            }
+            type = ST_BOOL;
+        }
+        void visit(UnaryExpression* unary) override {
+            StaticType st = check(unary->getLeft());
+            if (known(st) && !numeric(st))
+                error(unary, "can't negate a " + staticTypeStr[st]);
+            type = numeric(st) ? st : ST_ANY;
+        }
+        void visit(FunctionCall* fc) override {
+            StaticType st = check(fc->getName());
+            if (known(st) && st != ST_FUNCTION)
+                error(fc, "calling a " + staticTypeStr[st] + ", not a function");
+            for (auto arg : fc->getArgs()) {
+                check(arg);
+            }
+            type = ST_ANY;
+        }
+        void visit(ListExpression* le) override {
+            for (auto m : le->getExprsList()) {
+                check(m);
+            }
+            type = ST_VECTOR;
+        }
+        void visit(MapExpression* me) override {
+            for (auto& entry : me->getEntries()) {
+                check(entry.first);
+                check(entry.second);
+            }
+            type = ST_MAP;
+        }
+        void visit(SubscriptExpression* se) override {
+            StaticType container = check(se->getName());
+            StaticType position = check(se->getPosition());
+            if (known(container) && container != ST_VECTOR && container != ST_MAP && container != ST_STRING)
+                error(se, "can't subscript a " + staticTypeStr[container]);
+            else if ((container == ST_VECTOR || container == ST_STRING) && known(position) && !numeric(position))
+                error(se, staticTypeStr[container] + " index is a " + staticTypeStr[position] + ", not a number");
+            type = container == ST_STRING ? ST_STRING : ST_ANY;
+        }
+        //a slice of a vector is typed as one, since it can be used anywhere a vector can
+        void visit(SliceExpression* se) override {
+            StaticType container = check(se->getName());
+            for (auto bound : { se->getFrom(), se->getTo(), se->getStride() }) {
+                StaticType st = check(bound);
+                if (bound != nullptr && known(st) && !numeric(st))
+                    error(se, "slice bound is a " + staticTypeStr[st] + ", not a number");
+            }
+            if (known(container) && container != ST_VECTOR && container != ST_STRING)
+                error(se, "can't slice a " + staticTypeStr[container]);
+            type = container == ST_STRING ? ST_STRING : container == ST_VECTOR ? ST_VECTOR : ST_ANY;
+        }
+};
+
+#endif
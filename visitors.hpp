@@ -2,14 +2,18 @@
 #define visitors_hpp
 #include <vector>
 #include <list>
+#include <climits>
 #include "token.hpp"
 #include "syntaxtree.hpp"
+#include "profiler.hpp"
+#include "datafile.hpp"
+#include "closures.hpp"
 using namespace std;
 
 
-class PrintVisitor : public Visitor {
+class PrintVisitor : public Visitor<> {
     private:
-        int d;
+        int d = 0;
         void enter(string s = "") {
             ++d;
             say(s);
@@ -45,6 +49,13 @@ class PrintVisitor : public Visitor {
             ws->getLoopBody()->accept(this);
             leave();
         }
+        void visit(ForStatement* fs) override {
+            enter("For statement");
+            say(fs->getVarName());
+            fs->getIterable()->accept(this);
+            fs->getLoopBody()->accept(this);
+            leave();
+        }
         void visit(IfStatement* is) override {
             enter("if statement");
             is->getTest()->accept(this);
@@ -76,6 +87,14 @@ class PrintVisitor : public Visitor {
             assign->getRight()->accept(this);
             leave();
         }
+        void visit(IncrementExpression* inc) override {
+            enter("Increment Expression");
+            inc->getTarget()->accept(this);
+            ostringstream delta;
+            delta<<inc->getDelta();
+            say(delta.str());
+            leave();
+        }
         void visit(BinaryExpression* bin) override {
             enter("Binary Expression");
             say(bin->getToken().lexeme);
@@ -98,8 +117,9 @@ class PrintVisitor : public Visitor {
         }
         void visit(FuncDefStatement* ds) override {
             enter("Function Definition");
-            say(ds->getName());
-            ds->getParams()->accept(this);
+            say(ds->getName() + (ds->isMemoized() ? " (memo)" : "") + (ds->isGenerator() ? " (generator)" : ""));
+            if (ds->getParams() != nullptr)
+                ds->getParams()->accept(this);
             ds->getBody()->accept(this);
             leave();
         }
@@ -120,7 +140,13 @@ class PrintVisitor : public Visitor {
         }
         void visit(ReturnStatement* rs) override {
             enter("return statement");
-            rs->getRetVal()->accept(this);
+            if (rs->getRetVal() != nullptr)
+                rs->getRetVal()->accept(this);
+            leave();
+        }
+        void visit(YieldStatement* ys) override {
+            enter("yield statement");
+            ys->getValue()->accept(this);
             leave();
         }
         void visit(VarDefStatement* vd) override {
@@ -139,221 +165,1053 @@ class PrintVisitor : public Visitor {
             }
             leave();
         }
+        void visit(MapExpression* me) override {
+            enter("map expression");
+            for (auto& entry : me->getEntries()) {
+                entry.first->accept(this);
+                entry.second->accept(this);
+            }
+            leave();
+        }
         void visit(SubscriptExpression* se) override {
             enter("subscript expression");
             se->getName()->accept(this);
             se->getPosition()->accept(this);
             leave();
         }
+        void visit(SliceExpression* se) override {
+            enter("slice expression");
+            se->getName()->accept(this);
+            for (auto bound : { se->getFrom(), se->getTo(), se->getStride() }) {
+                if (bound != nullptr) bound->accept(this);
+                else say("default");
+            }
+            leave();
+        }
 }; 
 
-class Function {
+//Results of a memoized function, keyed on its argument values.
+//Once full the table is emptied rather than tracking recency.
+class MemoTable : public Tracked<MEM_FUNCTION> {
+    private:
+        typedef vector<Object> Key;
+        struct KeyHash {
+            size_t operator()(const Key& key) const {
+                size_t h = key.size();
+                for (auto& ob : key) h = h * 31 + ObjectMap::hashKey(ob);
+                return h;
+            }
+        };
+        struct KeyEq {
+            bool operator()(const Key& lhs, const Key& rhs) const {
+                if (lhs.size() != rhs.size()) return false;
+                //2 & 2.0 are one map key, but a function may well return different things for them
+                for (size_t i = 0; i < lhs.size(); i++) {
+                    if (!ObjectMap::sameKey(lhs[i], rhs[i]) || (isNumber(lhs[i]) && lhs[i].type != rhs[i].type)) return false;
+                }
+                return true;
+            }
+        };
+        unordered_map<Key, Object, KeyHash, KeyEq, TrackingAllocator<pair<const Key, Object>, MEM_FUNCTION>> table;
+        size_t capacity;
+    public:
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        MemoTable(size_t cap = 4096) : capacity(cap) { }
+        //vectors, arrays & maps can change between calls, so only scalar arguments are cached
+        static bool cacheable(const Object* args, int count) {
+            for (int i = 0; i < count; i++) {
+                if (args[i].type == VECTOR || args[i].type == MAP || args[i].type == FUNCTION || args[i].type == SEQUENCE ||
+                    args[i].type == ARRAY || args[i].type == SLICE || args[i].type == MATRIX)
+                    return false;
+            }
+            return true;
+        }
+        bool find(const Key& key, Object& value) {
+            auto it = table.find(key);
+            if (it == table.end()) {
+                misses++;
+                return false;
+            }
+            hits++;
+            value = it->second;
+            return true;
+        }
+        void store(Key key, const Object& value) {
+            if (table.size() >= capacity) {
+                table.clear();
+                evictions++;
+            }
+            table.emplace(std::move(key), value);
+        }
+        size_t size() const { return table.size(); }
+};
+
+class InterpreterVisitor;
+
+//Built-in functions get their arguments as a slice of the operand stack
+typedef Object (*Native)(InterpreterVisitor& iv, Object* args, int count);
+
+class Function : public Tracked<MEM_FUNCTION> {
     private:
         string name;
         ParameterList* params;
         StatementList* body;
+        MemoTable* memo;
+        bool generator;
+        Native native;
+        //the values of the variables it captured, in the order the def lists them
+        const vector<Capture>* captures;
+        vector<Object, TrackingAllocator<Object, MEM_FUNCTION>> upvalues;
     public:
-        Function(string n, ParameterList* p, StatementList* b) : name(n), params(p), body(b) { }
-        string getName() { return name; }
+        Function(string n, ParameterList* p, StatementList* b, bool memoize = false, bool gen = false,
+                 const vector<Capture>* caps = nullptr)
+            : name(std::move(n)), params(p), body(b), generator(gen), native(nullptr), captures(caps) {
+            //each call of a generator makes a new one, so there is never a result worth caching
+            memo = memoize && !gen ? new MemoTable() : nullptr;
+            if (captures != nullptr)
+                upvalues.resize(captures->size());
+        }
+        Function(string n, Native fn) : name(std::move(n)), params(nullptr), body(nullptr), memo(nullptr), generator(false), native(fn), captures(nullptr) { }
+        const string& getName() const { return name; }
         ParameterList* paramList() { return params; }
         StatementList* getBody() { return body; }
+        MemoTable* getMemo() { return memo; }
+        bool isGenerator() const { return generator; }
+        Native getNative() const { return native; }
+        size_t upvalueCount() const { return upvalues.size(); }
+        Object& upvalue(size_t slot) { return upvalues[slot]; }
+        const string& upvalueName(size_t slot) const { return (*captures)[slot].name; }
+        //whether this closure was made by the def that lays its upvalues out as caps
+        bool capturesFor(const vector<Capture>* caps) const { return captures == caps; }
+};
+
+//A series of values computed one at a time, as they are asked for
+class Sequence : public Tracked<MEM_SEQUENCE> {
+    public:
+        virtual ~Sequence() { }
+        virtual bool next(InterpreterVisitor& iv, Object& out) = 0;
+};
+
+//counts in integers when every bound is one, & in doubles otherwise
+template <class T>
+class RangeSequence : public Sequence {
+    private:
+        T at;
+        T end;
+        T step;
+    public:
+        RangeSequence(T from, T to, T by) : at(from), end(to), step(by) { }
+        bool next(InterpreterVisitor& iv, Object& out) override {
+            if (step == 0 || (step > 0 ? at >= end : at <= end))
+                return false;
+            out = Object(at);
+            at += step;
+            return true;
+        }
+};
+
+class VectorSequence : public Sequence {
+    private:
+        ObjectVector* vec;
+        size_t pos;
+    public:
+        VectorSequence(ObjectVector* v) : vec(v), pos(0) { }
+        bool next(InterpreterVisitor& iv, Object& out) override {
+            if (pos >= vec->size())
+                return false;
+            out = (*vec)[pos++];
+            return true;
+        }
+};
+
+class ArraySequence : public Sequence {
+    private:
+        NumArray* arr;
+        size_t pos;
+    public:
+        ArraySequence(NumArray* a) : arr(a), pos(0) { }
+        bool next(InterpreterVisitor& iv, Object& out) override {
+            if (pos >= arr->size())
+                return false;
+            out = Object((*arr)[pos++]);
+            return true;
+        }
+};
+
+class SliceSequence : public Sequence {
+    private:
+        Slice* slice;
+        size_t pos;
+    public:
+        SliceSequence(Slice* s) : slice(s), pos(0) { }
+        bool next(InterpreterVisitor& iv, Object& out) override {
+            if (pos >= slice->size())
+                return false;
+            out = slice->get(pos++);
+            return true;
+        }
 };
 
-class InterpreterVisitor : public Visitor {
+class MapSequence : public Sequence {
     private:
-        bool bailout;
+        Sequence* source;
+        Function* fn;
+    public:
+        MapSequence(Sequence* src, Function* f) : source(src), fn(f) { }
+        bool next(InterpreterVisitor& iv, Object& out) override;
+};
+
+class FilterSequence : public Sequence {
+    private:
+        Sequence* source;
+        Function* pred;
+    public:
+        FilterSequence(Sequence* src, Function* p) : source(src), pred(p) { }
+        bool next(InterpreterVisitor& iv, Object& out) override;
+};
+
+/*
+    A suspended call of a function containing yield. Rather than keeping a C++ stack alive,
+    the frame is just the call's environment plus the path to the yield it stopped at:
+    a statement index for each statement list, the branch taken for each if, and the
+    sequence & position for each for loop, outermost first. Resuming walks back down
+    that path without re-running anything before the yield.
+*/
+class GeneratorSequence : public Sequence {
+    public:
+        Function* fn;
+        Environment env;
+        vector<Object> path;
+        bool started;
+        bool done;
+        GeneratorSequence(Function* f, Environment e) : fn(f), env(std::move(e)), started(false), done(false) { }
+        bool next(InterpreterVisitor& iv, Object& out) override;
+};
+
+//Whoever hands out fuel: told when a budget runs dry, & returns once it has been topped up
+class FuelSource {
+    public:
+        virtual ~FuelSource() { }
+        virtual void outOfFuel(InterpreterVisitor& iv) = 0;
+};
+
+/*
+    Evaluates the tree directly: every visit returns its value, so intermediate results
+    live in locals & registers, and a call's arguments in a buffer on the C++ stack.
+    Statements return nil, and report a return or yield through bailout instead.
+*/
+class InterpreterVisitor : public Visitor<Object> {
+    private:
+        bool bailout = false;
         vector<Environment> envs;
         Environment env;
+        list<Function*> memoized;
+        Profiler* profiler = nullptr;
+        //generator state: 'unwound' collects the path out from a yield, 'resumePath' is followed back in
+        bool yielding = false;
+        bool resuming = false;
+        int generators = 0;
+        vector<Object> unwound;
+        vector<Object> resumePath;
+        size_t resumeAt = 0;
+        Object yielded;
         Object nilObject;
-        Object operands[31337];
-        int n = 0;
-        void push(Object e) {
-            operands[n++] = e;
-        }
-        Object pop() {
-            if (n > 0)
-                return operands[--n];
-            cout<<"Stack underflow."<<endl;
-            return nilObject;
-        }
-        Object peek(int k) {
-            return operands[(n-1)-k];
+        //one unit is burned per loop iteration & per call; with no source the tank never runs dry
+        long fuel = LONG_MAX;
+        FuelSource* fuelSource = nullptr;
+        //what the innermost function to run a return statement returned
+        Object returned;
+        //the script function whose body is running, & whose upvalues marked reads index into
+        Function* running = nullptr;
+        //arguments to calls with no more than this many are gathered on the C++ stack
+        static const int inlineArgs = 4;
+        Object eval(ExpressionNode* expr) {
+            return expr->accept(this);
         }
         /* This is quite possibly *the least* efficient way of doing this, 
            it is quite literally for demonstration purposes only. */
         void openScope() {
-            envs.push_back(env);
+            envs.push_back(std::move(env));
             env = Environment();
         }
         void closeScope() {
             if (!envs.empty()) {
-                env = envs.back();
+                env = std::move(envs.back());
                 envs.pop_back();
             }
         }
+        //an index into a slice or string, clamped to lie within it
+        long sliceBound(ExpressionNode* expr, long fallback, long length) {
+            if (expr == nullptr)
+                return fallback;
+            long at = integerOf(eval(expr));
+            return at < 0 ? 0 : (at > length ? length : at);
+        }
+        const Object& resumeStep() {
+            return resumePath[resumeAt++];
+        }
+        //calls func on count arguments, returning nil if it finishes without returning a value
+        Object invoke(Function* func, Object* args, int count) {
+            if (func->getNative() != nullptr)
+                return func->getNative()(*this, args, count);
+            if (func->getMemo() != nullptr && MemoTable::cacheable(args, count))
+                return invokeMemoized(func, args, count);
+            return enter(func, args, count);
+        }
+        //kept apart from invoke, so only calls that are cached make room for a key
+        Object invokeMemoized(Function* func, Object* args, int count) {
+            MemoTable* memo = func->getMemo();
+            vector<Object> key(args, args + count);
+            Object cached;
+            if (memo->find(key, cached))
+                return cached;
+            Object result = enter(func, args, count);
+            memo->store(std::move(key), result);
+            return result;
+        }
+        //binds a script function's parameters in a fresh scope & runs its body
+        Object enter(Function* func, Object* args, int count) {
+            static list<StatementNode*> noParams;
+            auto& paramsList = func->paramList() != nullptr ? func->paramList()->getParams() : noParams;
+            openScope();
+            int arg = 0;
+            for (auto pit = paramsList.begin(); pit != paramsList.end() && arg < count; pit++) {
+                env.emplace((dynamic_cast<VarDefStatement*>(*pit))->getName(), args[arg++]);
+            }
+            if (func->isGenerator()) {
+                //nothing runs until the first value is asked for
+                GeneratorSequence* gen = new GeneratorSequence(func, std::move(env));
+                closeScope();
+                return Object(gen);
+            }
+            if (profiler != nullptr)
+                profiler->enter(func->getName());
+            burn();
+            Function* caller = running;
+            running = func;
+            bailout = false;
+            returned = nilObject;
+            func->getBody()->accept(this);
+            Object result = returned;
+            bailout = false;
+            running = caller;
+            closeScope();
+            if (profiler != nullptr)
+                profiler->leave();
+            return result;
+        }
+        //a call with too many arguments for a buffer on the stack
+        Object invokeOnHeap(Function* func, list<ExpressionNode*>& exprs) {
+            vector<Object> args;
+            args.reserve(exprs.size());
+            for (auto arg : exprs)
+                args.push_back(eval(arg));
+            return invoke(func, args.data(), args.size());
+        }
+        static Sequence* sequenceOf(const Object& ob) {
+            if (ob.type == SEQUENCE) return ob.seq;
+            if (ob.type == VECTOR) return new VectorSequence(ob.vec);
+            if (ob.type == ARRAY) return new ArraySequence(ob.arr);
+            if (ob.type == SLICE) return new SliceSequence(ob.slice);
+            return nullptr;
+        }
+        static Object builtinRange(InterpreterVisitor& iv, Object* args, int count) {
+            bool integers = true;
+            for (int i = 0; i < count; i++) {
+                if (!isNumber(args[i])) {
+                    cout<<"range() takes numbers."<<endl;
+                    return Object();
+                }
+                integers = integers && args[i].type == INTEGER;
+            }
+            if (integers) {
+                switch (count) {
+                    case 1: return Object(new RangeSequence<int64_t>(0, args[0].intval, 1));
+                    case 2: return Object(new RangeSequence<int64_t>(args[0].intval, args[1].intval, 1));
+                    case 3: return Object(new RangeSequence<int64_t>(args[0].intval, args[1].intval, args[2].intval));
+                    default: break;
+                }
+            }
+            switch (count) {
+                case 1: return Object(new RangeSequence<double>(0, doubleOf(args[0]), 1));
+                case 2: return Object(new RangeSequence<double>(doubleOf(args[0]), doubleOf(args[1]), 1));
+                case 3: return Object(new RangeSequence<double>(doubleOf(args[0]), doubleOf(args[1]), doubleOf(args[2])));
+                default: break;
+            }
+            cout<<"range() takes 1 to 3 arguments."<<endl;
+            return Object();
+        }
+        static Object builtinMap(InterpreterVisitor& iv, Object* args, int count) {
+            Sequence* src = count == 2 ? sequenceOf(args[0]) : nullptr;
+            if (src == nullptr || args[1].type != FUNCTION) {
+                cout<<"map() takes a sequence and a function."<<endl;
+                return Object();
+            }
+            return Object(new MapSequence(src, args[1].func));
+        }
+        static Object builtinFilter(InterpreterVisitor& iv, Object* args, int count) {
+            Sequence* src = count == 2 ? sequenceOf(args[0]) : nullptr;
+            if (src == nullptr || args[1].type != FUNCTION) {
+                cout<<"filter() takes a sequence and a function."<<endl;
+                return Object();
+            }
+            return Object(new FilterSequence(src, args[1].func));
+        }
+        static Object builtinCollect(InterpreterVisitor& iv, Object* args, int count) {
+            Sequence* src = count == 1 ? sequenceOf(args[0]) : nullptr;
+            if (src == nullptr) {
+                cout<<"collect() takes a sequence."<<endl;
+                return Object();
+            }
+            ObjectVector* vec = new ObjectVector();
+            Object item;
+            while (src->next(iv, item)) {
+                iv.burn();
+                vec->push_back(item);
+            }
+            return Object(vec);
+        }
+        static Object builtinSum(InterpreterVisitor& iv, Object* args, int count) {
+            //arrays are summed in place, without boxing each element
+            if (count == 1 && args[0].type == ARRAY) {
+                double total = 0;
+                for (double d : *args[0].arr)
+                    total += d;
+                return Object(total);
+            }
+            if (count == 1 && args[0].type == MATRIX) {
+                double total = 0;
+                for (double d : *args[0].mat)
+                    total += d;
+                return Object(total);
+            }
+            Sequence* src = count == 1 ? sequenceOf(args[0]) : nullptr;
+            if (src == nullptr) {
+                cout<<"sum() takes a sequence or a matrix."<<endl;
+                return Object();
+            }
+            //integers are totalled as integers until the first double
+            int64_t whole = 0;
+            double total = 0;
+            bool integers = true;
+            Object item;
+            while (src->next(iv, item)) {
+                iv.burn();
+                if (!isNumber(item)) {
+                    cout<<"sum() expects numbers."<<endl;
+                    return Object();
+                }
+                if (integers && item.type == INTEGER) {
+                    whole = wrapAdd(whole, item.intval);
+                    continue;
+                }
+                if (integers) {
+                    total = whole;
+                    integers = false;
+                }
+                total += doubleOf(item);
+            }
+            return integers ? Object(whole) : Object(total);
+        }
+        static Object builtinCount(InterpreterVisitor& iv, Object* args, int count) {
+            Sequence* src = count == 1 ? sequenceOf(args[0]) : nullptr;
+            if (src == nullptr) {
+                cout<<"count() takes a sequence."<<endl;
+                return Object();
+            }
+            int64_t total = 0;
+            Object item;
+            while (src->next(iv, item)) {
+                iv.burn();
+                total++;
+            }
+            return Object(total);
+        }
+        static Object builtinLen(InterpreterVisitor& iv, Object* args, int count) {
+            if (count == 1) {
+                switch (args[0].type) {
+                    case VECTOR: return Object((int64_t)args[0].vec->size());
+                    case ARRAY:  return Object((int64_t)args[0].arr->size());
+                    case SLICE:  return Object((int64_t)args[0].slice->size());
+                    case MATRIX: return Object((int64_t)args[0].mat->rows());
+                    case MAP:    return Object((int64_t)args[0].map->size());
+                    case STRING: return Object((int64_t)args[0].stringval->size());
+                    case ROPE:   return Object((int64_t)args[0].rope->size());
+                    default: break;
+                }
+            }
+            cout<<"len() takes a vector, array, slice, matrix, map or string."<<endl;
+            return Object();
+        }
+        //matrix(rows, cols), filled with zeros or a given number, or matrix(rows) from a vector of equal length rows
+        static Object builtinMatrix(InterpreterVisitor& iv, Object* args, int count) {
+            if ((count == 2 || count == 3) && isNumber(args[0]) && isNumber(args[1]) && (count == 2 || isNumber(args[2]))) {
+                if (integerOf(args[0]) < 0 || integerOf(args[1]) < 0) {
+                    cout<<"A matrix can't have a negative size."<<endl;
+                    return Object();
+                }
+                return Object(new Matrix(integerOf(args[0]), integerOf(args[1]), count == 3 ? doubleOf(args[2]) : 0));
+            }
+            if (count == 1 && args[0].type == VECTOR) {
+                ObjectVector& rows = *args[0].vec;
+                long cols = rows.empty() ? 0 : sliceableLength(rows[0]);
+                for (auto& row : rows) {
+                    if (cols < 0 || isText(row) || sliceableLength(row) != cols) {
+                        cout<<"matrix() takes rows of numbers, all the same length."<<endl;
+                        return Object();
+                    }
+                }
+                Matrix* m = new Matrix(rows.size(), cols);
+                for (size_t i = 0; i < rows.size(); i++) {
+                    for (long j = 0; j < cols; j++) {
+                        Object cell = subscript(rows[i], Object((int64_t)j));
+                        if (!isNumber(cell)) {
+                            cout<<"Matrices only hold numbers."<<endl;
+                            return Object();
+                        }
+                        m->at(i, j) = doubleOf(cell);
+                    }
+                }
+                return Object(m);
+            }
+            cout<<"matrix() takes a row & column count, or a vector of rows."<<endl;
+            return Object();
+        }
+        static Object builtinMatmul(InterpreterVisitor& iv, Object* args, int count) {
+            if (count != 2 || args[0].type != MATRIX || args[1].type != MATRIX) {
+                cout<<"matmul() takes two matrices."<<endl;
+                return Object();
+            }
+            Matrix* product = args[0].mat->multiply(*args[1].mat);
+            if (product == nullptr) {
+                cout<<"Can't multiply a "<<args[0].mat->rows()<<"x"<<args[0].mat->cols()<<" matrix by a "
+                    <<args[1].mat->rows()<<"x"<<args[1].mat->cols()<<" one."<<endl;
+                return Object();
+            }
+            return Object(product);
+        }
+        static Object builtinTranspose(InterpreterVisitor& iv, Object* args, int count) {
+            if (count != 1 || args[0].type != MATRIX) {
+                cout<<"transpose() takes a matrix."<<endl;
+                return Object();
+            }
+            return Object(args[0].mat->transposed());
+        }
+        static bool filename(Object* args, int count, const char* builtin) {
+            if (count == 1 && isText(args[0]))
+                return true;
+            cout<<builtin<<"() takes a file name."<<endl;
+            return false;
+        }
+        static Object builtinMapFile(InterpreterVisitor& iv, Object* args, int count) {
+            NumArray* arr = filename(args, count, "mapfile") ? DataLoader().mapDoubles(string(textOf(args[0]))) : nullptr;
+            return arr != nullptr ? Object(arr) : Object();
+        }
+        static Object builtinReadNums(InterpreterVisitor& iv, Object* args, int count) {
+            NumArray* arr = filename(args, count, "readnums") ? DataLoader().readNumbers(string(textOf(args[0]))) : nullptr;
+            return arr != nullptr ? Object(arr) : Object();
+        }
+        static Object builtinReadCSV(InterpreterVisitor& iv, Object* args, int count) {
+            ObjectVector* cols = filename(args, count, "readcsv") ? DataLoader().readCSV(string(textOf(args[0]))) : nullptr;
+            return cols != nullptr ? Object(cols) : Object();
+        }
     public:
-        void visit(StatementList* sl) override {
-            for (auto m : sl->getStatements()) {
-                m->accept(this);
+        InterpreterVisitor() {
+            env["range"] = Object(new Function("range", builtinRange));
+            env["map"] = Object(new Function("map", builtinMap));
+            env["filter"] = Object(new Function("filter", builtinFilter));
+            env["collect"] = Object(new Function("collect", builtinCollect));
+            env["sum"] = Object(new Function("sum", builtinSum));
+            env["count"] = Object(new Function("count", builtinCount));
+            env["len"] = Object(new Function("len", builtinLen));
+            env["mapfile"] = Object(new Function("mapfile", builtinMapFile));
+            env["readnums"] = Object(new Function("readnums", builtinReadNums));
+            env["readcsv"] = Object(new Function("readcsv", builtinReadCSV));
+            env["matrix"] = Object(new Function("matrix", builtinMatrix));
+            env["matmul"] = Object(new Function("matmul", builtinMatmul));
+            env["transpose"] = Object(new Function("transpose", builtinTranspose));
+        }
+        //charges one unit of fuel, handing control to the fuel source once the tank is empty
+        void burn() {
+            if (--fuel <= 0) {
+                if (fuelSource != nullptr) fuelSource->outOfFuel(*this);
+                else fuel = LONG_MAX;
+            }
+        }
+        void setFuel(long units) { fuel = units; }
+        long fuelLeft() const { return fuel; }
+        void setFuelSource(FuelSource* source) { fuelSource = source; }
+        //calls a script function from native code, such as a map() view
+        Object call(Function* func, Object* args, int count) {
+            return invoke(func, args, count);
+        }
+        //runs a generator on to its next yield, returning false once it has finished
+        bool resume(GeneratorSequence& gen, Object& out) {
+            if (gen.done)
+                return false;
+            //whoever is asking may be a generator part way through resuming itself
+            vector<Object> outerPath = std::move(resumePath);
+            vector<Object> outerUnwound = std::move(unwound);
+            size_t outerAt = resumeAt;
+            bool outerResuming = resuming;
+            resumePath = std::move(gen.path);
+            resumeAt = 0;
+            resuming = gen.started;
+            unwound.clear();
+            envs.push_back(std::move(env));
+            env = std::move(gen.env);
+            if (profiler != nullptr)
+                profiler->enter(gen.fn->getName());
+            Function* caller = running;
+            running = gen.fn;
+            generators++;
+            gen.fn->getBody()->accept(this);
+            generators--;
+            running = caller;
+            if (profiler != nullptr)
+                profiler->leave();
+            gen.started = true;
+            if (yielding) {
+                out = yielded;
+                gen.path.assign(unwound.rbegin(), unwound.rend());
+                gen.env = std::move(env);
+            } else {
+                gen.done = true;
+                gen.path.clear();
+            }
+            yielding = false;
+            bailout = false;
+            env = std::move(envs.back());
+            envs.pop_back();
+            resumePath = std::move(outerPath);
+            unwound = std::move(outerUnwound);
+            resumeAt = outerAt;
+            resuming = outerResuming;
+            return !gen.done;
+        }
+        //the outermost scope, where a program's top-level names live
+        Environment& globals() { return envs.empty() ? env : envs.front(); }
+        //binds a global from outside any program, as restoring a snapshot does
+        void define(const string& name, const Object& value) {
+            if (value.type == FUNCTION && value.func->getMemo() != nullptr)
+                memoized.push_back(value.func);
+            globals()[name] = value;
+        }
+        //calls are only reported while a profiler is set, so leaving it unset costs one test per call
+        void setProfiler(Profiler* prof) { profiler = prof; }
+        void reportMemo(ostream& os) {
+            os<<left<<setw(20)<<"memoized function"<<right<<setw(10)<<"entries"<<setw(12)<<"hits"
+              <<setw(12)<<"misses"<<setw(10)<<"hit rate"<<setw(11)<<"evictions"<<endl;
+            for (auto func : memoized) {
+                MemoTable* memo = func->getMemo();
+                size_t calls = memo->hits + memo->misses;
+                os<<left<<setw(20)<<func->getName()<<right<<setw(10)<<memo->size()<<setw(12)<<memo->hits
+                  <<setw(12)<<memo->misses<<setw(9)<<fixed<<setprecision(1)<<(calls ? 100.0*memo->hits/calls : 0.0)<<"%"
+                  <<setw(11)<<memo->evictions<<endl;
+            }
+            os<<defaultfloat;
+        }
+        Object visit(StatementList* sl) override {
+            auto& stmts = sl->getStatements();
+            auto it = stmts.begin();
+            int i = 0;
+            if (resuming) {
+                i = resumeStep().numval;
+                advance(it, i);
+            }
+            for (; it != stmts.end(); it++, i++) {
+                (*it)->accept(this);
                 if (bailout) {
+                    if (yielding) unwound.push_back(Object((double)i));
                     break;
                 }
             }
+            return nilObject;
         }
-        void visit(ProgramStatement* ps) override {
+        Object visit(ProgramStatement* ps) override {
+            CaptureAnalysis().run(ps);
             ps->getStatement()->accept(this);
+            return nilObject;
         }
-        void visit(PrintStatement* ps) override {
-            ps->getExpression()->accept(this);
-            cout<<pop()<<endl;
+        Object visit(PrintStatement* ps) override {
+            cout<<eval(ps->getExpression())<<endl;
+            return nilObject;
         }
-        void visit(WhileStatement* ws) override {
+        Object visit(WhileStatement* ws) override {
             ExpressionNode* testExpr = ws->getTestExpr();
             StatementList* stmt = ws->getLoopBody();
-            for (;;) {
-                testExpr->accept(this);
-                if (pop().boolval) {
+            //a generator resumed inside the body already passed the test for this iteration
+            if (resuming)
+                stmt->accept(this);
+            while (!bailout) {
+                burn();
+                if (eval(testExpr).boolval) {
                     stmt->accept(this);
                 } else break;
             }
+            return nilObject;
         }
-        void visit(IfStatement* is) override {
-            is->getTest()->accept(this);
-            if (pop().boolval) {
-                is->getPassCase()->accept(this);
+        Object visit(ForStatement* fs) override {
+            Object seq;
+            size_t i = 0;
+            bool resumed = resuming;
+            if (resumed) {
+                seq = resumeStep();
+                i = resumeStep().numval;
             } else {
-                if (is->getFailCase() != nullptr)
-                    is->getFailCase()->accept(this);
+                seq = eval(fs->getIterable());
+            }
+            if (seq.type != VECTOR && seq.type != ARRAY && seq.type != SLICE && seq.type != SEQUENCE) {
+                cout<<"Can only iterate over vectors, arrays, slices & sequences."<<endl;
+                return nilObject;
             }
+            //the loop variable's slot is resolved once, elements are copied straight into it
+            Object& cursor = env[fs->getVarName()];
+            StatementList* body = fs->getLoopBody();
+            if (seq.type == VECTOR) {
+                for (; i < seq.vec->size(); i++) {
+                    cursor = (*seq.vec)[i];
+                    burn();
+                    body->accept(this);
+                    if (bailout) break;
+                }
+            } else if (seq.type == ARRAY) {
+                for (; i < seq.arr->size(); i++) {
+                    cursor = Object((*seq.arr)[i]);
+                    burn();
+                    body->accept(this);
+                    if (bailout) break;
+                }
+            } else if (seq.type == SLICE) {
+                for (; i < seq.slice->size(); i++) {
+                    cursor = seq.slice->get(i);
+                    burn();
+                    body->accept(this);
+                    if (bailout) break;
+                }
+            } else {
+                //sequences are consumed as they go, without ever holding more than one value
+                while (resumed || seq.seq->next(*this, cursor)) {
+                    resumed = false;
+                    burn();
+                    body->accept(this);
+                    if (bailout) break;
+                }
+            }
+            if (yielding) {
+                unwound.push_back(Object((double)i));
+                unwound.push_back(seq);
+            }
+            return nilObject;
         }
-        void visit(VarDefStatement* vd) override {
+        Object visit(IfStatement* is) override {
+            bool pass;
+            if (resuming) {
+                pass = resumeStep().boolval;
+            } else {
+                pass = eval(is->getTest()).boolval;
+            }
+            StatementList* branch = pass ? is->getPassCase() : is->getFailCase();
+            if (branch != nullptr) {
+                branch->accept(this);
+                if (yielding) unwound.push_back(Object(pass));
+            }
+            return nilObject;
+        }
+        Object visit(VarDefStatement* vd) override {
             env[vd->getName()] = nilObject;
             if (vd->getExpr() != nullptr) {
-                vd->getExpr()->accept(this);
+                eval(vd->getExpr());
             }
+            return nilObject;
         }
-        void visit(ExprStatement* es) override {
+        Object visit(ExprStatement* es) override {
             if (es->getExpression() != nullptr)
-                es->getExpression()->accept(this);
+                eval(es->getExpression());
+            return nilObject;
         }
-        void visit(UnaryExpression* unary) override {
-            unary->getLeft()->accept(this);
-            Object t = pop();
-            t.numval = -t.numval;
-            push(t);
+        Object visit(UnaryExpression* unary) override {
+            return negative(eval(unary->getLeft()));
         }
-        void visit(IdExpression* idexpr) override {
-            string id = idexpr->getId();
-            if (env.find(id) == env.end()) {
-                for (int i = envs.size()-1; i >= 0; i--) {
-                    if (envs[i].find(id) != envs[i].end()) {
-                        push(envs[i].at(id));
-                        return;
-                    }
-                }
-                cout<<"Hmmm, couldnt find: "<<id<<endl;
-            } else {
-                push(env[idexpr->getId()]);
+        Object visit(IdExpression* idexpr) override {
+            int slot = idexpr->getUpvalue();
+            if (slot >= 0)
+                return running->upvalue(slot);
+            const string& id = idexpr->getId();
+            auto it = env.find(id);
+            if (it != env.end())
+                return it->second;
+            //scope is lexical: a name that is neither local nor captured can only be a global
+            if (!envs.empty()) {
+                auto found = envs.front().find(id);
+                if (found != envs.front().end())
+                    return found->second;
             }
+            cout<<"Hmmm, couldnt find: "<<id<<endl;
+            return nilObject;
         }
-        void visit(LiteralExpression* lit) override {
-            push(Object(lit->eval(env)));
+        Object visit(LiteralExpression* lit) override {
+            return lit->eval(env);
         }
-        void visit(AssignExpression* assign) override {
-            string id = assign->getLeft()->getToken().lexeme;
+        Object visit(AssignExpression* assign) override {
+            const string& id = assign->getLeft()->getToken().lexeme;
             if (id == "[") {
                 auto x = dynamic_cast<SubscriptExpression*>(assign->getLeft());
-                while (x->getName()->getId() == "[") x = dynamic_cast<SubscriptExpression*>(x->getName());
-                x->getName()->accept(this);
-                Object m = pop();
-                x->getPosition()->accept(this);
-                int pos = pop().numval;
-                assign->getRight()->accept(this);
-                Object ans = pop();
-                m.vec->at(pos) = ans;
+                auto row = dynamic_cast<SubscriptExpression*>(x->getName());
+                if (row != nullptr) {
+                    //m[i][j] := v goes straight into a matrix, & otherwise into whatever m[i] evaluates to
+                    Object m = eval(row->getName());
+                    Object i = eval(row->getPosition());
+                    Object j = eval(x->getPosition());
+                    Object value = eval(assign->getRight());
+                    storeElement(m, i, j, value);
+                } else {
+                    Object m = eval(x->getName());
+                    Object key = eval(x->getPosition());
+                    Object value = eval(assign->getRight());
+                    storeElement(m, key, value);
+                }
             } else {
-                assign->getRight()->accept(this);
-                env[id] = pop();
+                //evaluated first: the right hand side may add names to env, moving its slots
+                Object value = eval(assign->getRight());
+                env[id] = value;
             }
+            return nilObject;
         }
-        void visit(BinaryExpression* bin) override {
-            bin->getLeft()->accept(this);
-            bin->getRight()->accept(this);
-            Object rhs = pop();
-            Object lhs = pop();
+        Object visit(IncrementExpression* inc) override {
+            const string& id = inc->getTarget()->getId();
+            const Object& delta = inc->getDelta();
+            auto it = env.find(id);
+            //'s := s + 1' is an increment too, and on text it appends
+            if (it != env.end()) {
+                Object& value = it->second;
+                if (value.type == INTEGER && delta.type == INTEGER) value.intval = wrapAdd(value.intval, delta.intval);
+                else if (value.type == NUMBER && delta.type == NUMBER) value.numval += delta.numval;
+                else value = add(value, delta);
+            } else {
+                env[id] = add(eval(inc->getTarget()), delta);
+            }
+            return nilObject;
+        }
+        Object visit(BinaryExpression* bin) override {
+            Object lhs = eval(bin->getLeft());
+            Object rhs = eval(bin->getRight());
+            //both sides were proven integers or doubles by the type checker, so no tags need checking
+            if (bin->getLeft()->isInteger() && bin->getRight()->isInteger()) {
+                switch (bin->getToken().type) {
+                    case TK_PLUS:  return Object(wrapAdd(lhs.intval, rhs.intval));
+                    case TK_MINUS: return Object(wrapSub(lhs.intval, rhs.intval));
+                    case TK_MULT:  return Object(wrapMul(lhs.intval, rhs.intval));
+                    case TK_DIV:   return Object((double)lhs.intval / rhs.intval);
+                    default:
+                        break;
+                }
+                return lhs;
+            }
+            if (bin->getLeft()->isNumeric() && bin->getRight()->isNumeric()) {
+                switch (bin->getToken().type) {
+                    case TK_PLUS:  return Object(lhs.numval + rhs.numval);
+                    case TK_MINUS: return Object(lhs.numval - rhs.numval);
+                    case TK_MULT:  return Object(lhs.numval * rhs.numval);
+                    case TK_DIV:   return Object(lhs.numval / rhs.numval);
+                    default:
+                        break;
+                }
+                return lhs;
+            }
             switch (bin->getToken().type) {
-                case TK_PLUS:  push(add(lhs,rhs)); break;
-                case TK_MINUS: push(sub(lhs,rhs)); break;
-                case TK_MULT:  push(mul(lhs,rhs)); break;
-                case TK_DIV:   push(div(lhs,rhs)); break;
+                case TK_PLUS:  return add(lhs,rhs);
+                case TK_MINUS: return sub(lhs,rhs);
+                case TK_MULT:  return mul(lhs,rhs);
+                case TK_DIV:   return div(lhs,rhs);
                 default:
                     break;
             }
+            return lhs;
         }
-        void visit(RelOpExpression* rel) override {
-            rel->getLeft()->accept(this);
-            rel->getRight()->accept(this);
-            Object rhs = pop();
-            Object lhs = pop();
+        Object visit(RelOpExpression* rel) override {
+            Object lhs = eval(rel->getLeft());
+            Object rhs = eval(rel->getRight());
+            if (rel->getLeft()->isInteger() && rel->getRight()->isInteger()) {
+                int64_t l = lhs.intval, r = rhs.intval;
+                switch (rel->getToken().type) {
+                    case TK_EQU: return Object(l == r);
+                    case TK_NEQ: return Object(l != r);
+                    case TK_LT:  return Object(l < r);
+                    case TK_GT:  return Object(l > r);
+                    case TK_LTE: return Object(l <= r);
+                    case TK_GTE: return Object(l >= r);
+                    default:
+                        break;
+                }
+                return Object(false);
+            }
+            if (rel->getLeft()->isNumeric() && rel->getRight()->isNumeric()) {
+                double l = lhs.numval, r = rhs.numval;
+                switch (rel->getToken().type) {
+                    case TK_EQU: return Object(l == r);
+                    case TK_NEQ: return Object(l != r);
+                    case TK_LT:  return Object(l < r);
+                    case TK_GT:  return Object(l > r);
+                    case TK_LTE: return Object(l <= r);
+                    case TK_GTE: return Object(l >= r);
+                    default:
+                        break;
+                }
+                return Object(false);
+            }
             switch (rel->getToken().type) {
-                case TK_EQU: push(eq(lhs, rhs)); break;
-                case TK_NEQ: push(neq(lhs,rhs)); break;
-                case TK_LT: push(lt(lhs, rhs)); break;
-                case TK_GT: push(gt(lhs, rhs)); break;
-                case TK_LTE: push(lte(lhs, rhs)); break;
-                case TK_GTE: push(gte(lhs, rhs)); break;
+                case TK_EQU: return eq(lhs, rhs);
+                case TK_NEQ: return neq(lhs,rhs);
+                case TK_LT: return lt(lhs, rhs);
+                case TK_GT: return gt(lhs, rhs);
+                case TK_LTE: return lte(lhs, rhs);
+                case TK_GTE: return gte(lhs, rhs);
                 default:
                     break;
             }
+            return lhs;
         }
-        void visit(FuncDefStatement* ds) override {
-            env[ds->getName()] = Object(new Function(ds->getName(), ds->getParams(), ds->getBody()));
+        Object visit(FuncDefStatement* ds) override {
+            auto& captures = ds->getCaptures();
+            Function* func = new Function(ds->getName(), ds->getParams(), ds->getBody(), ds->isMemoized(), ds->isGenerator(), &captures);
+            if (func->getMemo() != nullptr)
+                memoized.push_back(func);
+            env[ds->getName()] = Object(func);
+            //copied once the function is bound, so a nested function can call itself
+            for (size_t i = 0; i < captures.size(); i++) {
+                if (captures[i].from >= 0) {
+                    func->upvalue(i) = running->upvalue(captures[i].from);
+                } else {
+                    //a local the definer hasn't bound yet is captured as nil
+                    auto it = env.find(captures[i].name);
+                    if (it != env.end()) func->upvalue(i) = it->second;
+                }
+            }
+            //siblings defined before this one captured it as nil, & now get it
+            for (auto& fwd : ds->getForwards()) {
+                auto it = env.find(fwd.def->getName());
+                if (it != env.end() && it->second.type == FUNCTION && it->second.func->capturesFor(&fwd.def->getCaptures()))
+                    it->second.func->upvalue(fwd.slot) = Object(func);
+            }
+            return nilObject;
         }
-        void visit(ReturnStatement* rs) override {
-            rs->getRetVal()->accept(this);
+        Object visit(ReturnStatement* rs) override {
+            //a bare 'return;' returns nil
+            returned = rs->getRetVal() != nullptr ? eval(rs->getRetVal()) : nilObject;
             bailout = true;
+            return nilObject;
         }
-        void visit(ParameterList* pl) override {
-            
+        Object visit(YieldStatement* ys) override {
+            //the yield a generator stopped at: carry on from just after it
+            if (resuming) {
+                resuming = false;
+                return nilObject;
+            }
+            if (generators == 0) {
+                cout<<"yield outside of a generator."<<endl;
+                return nilObject;
+            }
+            yielded = eval(ys->getValue());
+            yielding = true;
+            bailout = true;
+            return nilObject;
         }
-        void visit(FunctionCall* fc) override {
-            fc->getName()->accept(this);
-            Function* func = pop().func;
-            auto argsList = fc->getArgs();
-            auto paramsList = func->paramList()->getParams();
-            auto ait = argsList.begin();
-            auto pit = paramsList.begin();
-            openScope();
-            while (ait != argsList.end() && pit != paramsList.end()) {
-                string id = (dynamic_cast<VarDefStatement*>(*pit))->getName();
-                (*ait)->accept(this);
-                env.emplace(id,pop());
-                ait++;
-                pit++;
+        Object visit(ParameterList* pl) override {
+            return nilObject;
+        }
+        Object visit(FunctionCall* fc) override {
+            Object callee = eval(fc->getName());
+            if (callee.type != FUNCTION) {
+                cout<<"Can't call "<<callee<<", it isn't a function."<<endl;
+                return nilObject;
             }
-            bailout = false;
-            func->getBody()->accept(this);
-            bailout = false;
-            closeScope();
+            auto& exprs = fc->getArgs();
+            int count = exprs.size();
+            if (count > inlineArgs)
+                return invokeOnHeap(callee.func, exprs);
+            Object args[inlineArgs];
+            int i = 0;
+            for (auto arg : exprs)
+                args[i++] = eval(arg);
+            return invoke(callee.func, args, count);
         }
-        void visit(SubscriptExpression* se) override {
-            se->getName()->accept(this);
-            auto object = pop();
-            se->getPosition()->accept(this);
-            int position = pop().numval;
-            auto result = object.vec->at(position);
-            push(result);
+        Object visit(SubscriptExpression* se) override {
+            //m[i][j] reads a matrix element in place, rather than through a slice of row i
+            auto row = dynamic_cast<SubscriptExpression*>(se->getName());
+            if (row != nullptr) {
+                Object object = eval(row->getName());
+                Object i = eval(row->getPosition());
+                Object j = eval(se->getPosition());
+                return subscript(object, i, j);
+            }
+            Object object = eval(se->getName());
+            Object key = eval(se->getPosition());
+            return subscript(object, key);
         }
-        void visit(ListExpression* le) override {
-            vector<Object>* vec = new vector<Object>();
+        Object visit(SliceExpression* se) override {
+            Object object = eval(se->getName());
+            long length = sliceableLength(object);
+            if (length < 0) {
+                cout<<"Can only slice vectors, arrays, slices & strings."<<endl;
+                return nilObject;
+            }
+            long from = sliceBound(se->getFrom(), 0, length);
+            long to = sliceBound(se->getTo(), length, length);
+            long stride = 1;
+            if (se->getStride() != nullptr) {
+                stride = integerOf(eval(se->getStride()));
+                if (stride < 1) {
+                    cout<<"Slice stride must be at least 1."<<endl;
+                    return nilObject;
+                }
+            }
+            size_t count = to > from ? (to - from + stride - 1) / stride : 0;
+            return sliceOf(object, from, count, stride);
+        }
+        Object visit(ListExpression* le) override {
+            ObjectVector* vec = new ObjectVector();
+            vec->reserve(le->getExprsList().size());
             for (auto m : le->getExprsList()) {
-                m->accept(this);
-                Object obj = pop();
-                cout<<obj<<endl;
-                vec->push_back(obj);
+                vec->push_back(eval(m));
+            }
+            return Object(vec);
+        }
+        Object visit(MapExpression* me) override {
+            ObjectMap* map = new ObjectMap(me->getEntries().size());
+            for (auto& entry : me->getEntries()) {
+                Object key = eval(entry.first);
+                Object value = eval(entry.second);
+                if (key.type == NIL) cout<<"nil is not a valid map key."<<endl;
+                else map->set(key, value);
             }
-            push(Object(vec));
+            return Object(map);
         }
 };
 
+inline bool MapSequence::next(InterpreterVisitor& iv, Object& out) {
+    Object item;
+    if (!source->next(iv, item))
+        return false;
+    out = iv.call(fn, &item, 1);
+    return true;
+}
+
+inline bool FilterSequence::next(InterpreterVisitor& iv, Object& out) {
+    Object item;
+    while (source->next(iv, item)) {
+        if (iv.call(pred, &item, 1).boolval) {
+            out = item;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool GeneratorSequence::next(InterpreterVisitor& iv, Object& out) {
+    return iv.resume(*this, out);
+}
+
 #endif
\ No newline at end of file